@@ -33,8 +33,10 @@
 #ifndef TR2DRAW_H_INCLUDED
 #define TR2DRAW_H_INCLUDED
 
-#include <windows.h>
+#include "winShim.h"
+#include "drawStats.h"
 #include "generalDraw.h"
+#include "texturePage.h"
 
 /** @cond Doxygen_Suppress */
 #ifdef BUILDING_TR2DRAW_DLL
@@ -51,6 +53,9 @@ typedef enum {
 	WPT_ANIMATED = 2,	///< Wallpaper is animated pattern. Used for TR2 PlayStation styled inventory
 } WPTYPE;
 
+/// Wallpaper instance (opaque)
+typedef struct WALLPAPER WALLPAPER;
+
 /**
  * Draws wallpaper to the game screen
  * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
@@ -64,6 +69,202 @@ typedef enum {
  */
 TR2DRAW_DLL void DrawWallpaper(TR2CONTEXT *ctx, TEXTURE *txr, WPTYPE wpType, int frameSpeed);
 
+/**
+ * Draws wallpaper to the game screen at the given time. The animated
+ * wallpaper phases are advanced by the time elapsed since the previous
+ * call, so the animation speed does not depend on the frame rate
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] txr Pointer to the Texture structure. Ignored if
+ * wpType == WPT_IMAGE
+ * @param[in] wpType Wallpaper type to draw. Available values:
+ * WPT_IMAGE, WPT_STATIC, WPT_ANIMATED
+ * @param[in] timestamp Monotonic time (microseconds from any origin, e.g.
+ * QueryPerformanceCounter() value converted to microseconds). Used only if
+ * wpType == WPT_ANIMATED. Pauses longer than one second are shortened
+ */
+TR2DRAW_DLL void DrawWallpaperAt(TR2CONTEXT *ctx, TEXTURE *txr, WPTYPE wpType, long long timestamp);
+
+/**
+ * Creates wallpaper instance. The instance has its own animation phases,
+ * pattern detail controller, caches and buffers, so several instances may
+ * be animated independently (i.e. for several viewports). DrawWallpaper()
+ * and the wallpaper settings use the default instance, new instances start
+ * with the default settings and the disabled wallpaper cache. Each instance
+ * has its own draw batch and frame constants, so different instances may be
+ * drawn from different threads at once; the device submissions are serialized
+ * internally, and the cached or captured draws are serialized entirely.
+ * One instance must not be used by two threads at once, and the settings
+ * functions must not be called while a draw is in progress
+ * @return Pointer to the wallpaper instance, or NULL if there is not enough memory
+ */
+TR2DRAW_DLL WALLPAPER *CreateWallpaper(void);
+
+/**
+ * Destroys wallpaper instance. Its cache page is released through the texture page callback
+ * @param[in] wallpaper Pointer to the wallpaper instance. May be NULL
+ */
+TR2DRAW_DLL void DestroyWallpaper(WALLPAPER *wallpaper);
+
+/**
+ * Advances animation of the wallpaper instance by a part of the game frame
+ * @param[in,out] wallpaper Pointer to the wallpaper instance. Ignored if NULL
+ * @param[in] frameSpeed Framerate factor. The phases are advanced by 1/frameSpeed of the game frame
+ */
+TR2DRAW_DLL void AdvanceWallpaper(WALLPAPER *wallpaper, int frameSpeed);
+
+/**
+ * Advances animation of the wallpaper instance to the given time
+ * @param[in,out] wallpaper Pointer to the wallpaper instance. Ignored if NULL
+ * @param[in] timestamp Monotonic time (microseconds). The first call only
+ * sets the time origin. Pauses longer than one second are shortened
+ */
+TR2DRAW_DLL void AdvanceWallpaperTo(WALLPAPER *wallpaper, long long timestamp);
+
+/**
+ * Draws wallpaper instance to the game screen. The animation is not advanced
+ * @param[in,out] wallpaper Pointer to the wallpaper instance. Nothing is drawn if NULL
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] txr Pointer to the Texture structure. Ignored if
+ * wpType == WPT_IMAGE
+ * @param[in] wpType Wallpaper type to draw. Available values:
+ * WPT_IMAGE, WPT_STATIC, WPT_ANIMATED
+ */
+TR2DRAW_DLL void DrawWallpaperInstance(WALLPAPER *wallpaper, TR2CONTEXT *ctx, TEXTURE *txr, WPTYPE wpType);
+
+/**
+ * Sets texture page callbacks. The DLL-generated textures (i.e. bitmap
+ * wallpaper tiles) are uploaded and released by the game through them
+ * @param[in] upload Upload callback. NULL disables the DLL-generated textures
+ * @param[in] release Release callback. May be NULL
+ */
+TR2DRAW_DLL void SetTexturePageCallbacks(TEXPAGEUPLOADFUNC upload, TEXPAGERELEASEFUNC release);
+
+/**
+ * Sets render target callback. It is needed by the wallpaper cache only
+ * @param[in] target Render target callback. NULL disables the wallpaper cache
+ */
+TR2DRAW_DLL void SetRenderTargetCallback(TEXPAGETARGETFUNC target);
+
+/**
+ * Sets render target creation callback. The wallpaper cache creates the
+ * screen sized render targets through it. Without it the cache renders to
+ * the texture pages created by the upload callback
+ * @param[in] create Render target creation callback. May be NULL
+ */
+TR2DRAW_DLL void SetRenderTargetCreateCallback(TEXTARGETCREATEFUNC create);
+
+/**
+ * Enables or disables the wallpaper cache of the default instance. The
+ * cached pattern wallpaper is rendered to a screen sized render target (or a
+ * texture page without the render target creation callback) and drawn as one
+ * full screen quad. The target is rendered again when the screen, the
+ * wallpaper type, the texture or the wallpaper parameters (including the
+ * adapted detail level) are changed, and every animatedPeriod frames for the
+ * animated wallpaper. If the target fails, the cache is not used until
+ * InvalidateTexturePages() is called. It needs the render target callback and
+ * is disabled by default
+ * @param[in] enable TRUE to enable the cache, FALSE to disable it
+ * @param[in] animatedPeriod Number of frames the animated wallpaper page is
+ * used for. Zero or negative value restores the default
+ */
+TR2DRAW_DLL void SetWallpaperCache(BOOL enable, int animatedPeriod);
+
+/**
+ * Sets bitmap image drawn as WPT_IMAGE wallpaper. The image is copied and
+ * split into texture page tiles, which are uploaded once on the next draw
+ * and reused by the later draws. Call it only when the image is changed
+ * @param[in] pixels Image pixels (RGBA). NULL removes the image
+ * @param[in] width,height Image size (pixels)
+ * @param[in] pitch Number of pixels per image row
+ * @return TRUE if the image is set, FALSE if there is not enough memory
+ */
+TR2DRAW_DLL BOOL SetWallpaperImage(const D3DCOLOR *pixels, int width, int height, int pitch);
+
+/**
+ * Informs the library that the textures it uploaded are lost (i.e. the
+ * device was recreated). The pages are uploaded again on the next draw
+ * to the same handles
+ */
+TR2DRAW_DLL void InvalidateTexturePages(void);
+
+/**
+ * Sets detail level of the animated wallpaper of the default instance
+ * (number of quads per texture tile along each axis). If the time budget
+ * is set, it is the starting level
+ * @param[in] detail Detail level. Zero or negative value restores the default
+ */
+TR2DRAW_DLL void SetWallpaperDetail(int detail);
+
+/**
+ * Sets CPU time budget of the animated wallpaper of the default instance.
+ * The detail level is adapted to the measured cost of the recent frames
+ * to fit the budget
+ * @param[in] budget Time budget per frame (microseconds). Zero disables
+ * adaptive detail, negative value restores the default
+ */
+TR2DRAW_DLL void SetWallpaperTimeBudget(float budget);
+
+/**
+ * Sets sine table variant of the animated wallpaper waves. The default table
+ * has one entry per 16 angles, which shows as stepping on high detail levels
+ * @param[in] variant Sine table variant: 0 - nearest entry (default),
+ * 1 - linear interpolation, 2 - one entry per angle (32 KB table)
+ */
+TR2DRAW_DLL void SetWallpaperSineTable(int variant);
+
+/**
+ * Informs the library about render state set by the game. The library
+ * will not send this state to the device again while the value stays the same
+ * @param[in] state Render state type
+ * @param[in] value Render state value
+ */
+TR2DRAW_DLL void SyncRenderState(D3DRENDERSTATETYPE state, DWORD value);
+
+/**
+ * Gets render state value applied to the device by the library or reported
+ * by SyncRenderState(). The game may skip setting the state if the value is the same
+ * @param[in] state Render state type
+ * @param[out] value Pointer to the render state value
+ * @return TRUE if the applied value is known, FALSE otherwise
+ */
+TR2DRAW_DLL BOOL GetRenderState(D3DRENDERSTATETYPE state, DWORD *value);
+
+/**
+ * Informs the library that the render states of the device are unknown
+ * (i.e. the device was recreated or the states were set bypassing SyncRenderState)
+ */
+TR2DRAW_DLL void InvalidateRenderStates(void);
+
+/**
+ * Gets draw statistics: counters of the latest frame and since reset,
+ * and CPU time of DrawWallpaper() for each wallpaper type over the latest
+ * STATS_HISTORY_SIZE calls. Timing array is indexed by WPTYPE
+ * @param[out] stats Pointer to the statistics structure
+ */
+TR2DRAW_DLL void GetDrawStats(DRAWSTATS *stats);
+
+/**
+ * Resets draw statistics
+ */
+TR2DRAW_DLL void ResetDrawStats(void);
+
+/**
+ * Starts capture of all device commands sent by the library, and the
+ * context values of each frame, to the binary file. The file may be
+ * replayed without the game by the replay tool
+ * @param[in] fileName Name of the capture file
+ * @return TRUE if the capture is started, FALSE otherwise
+ */
+TR2DRAW_DLL BOOL StartCapture(const char *fileName);
+
+/**
+ * Stops capture and writes the frame index to the capture file. If writing
+ * to the file fails, the frames are not captured anymore, and the failure
+ * is reported when the capture is stopped
+ * @return TRUE if the capture file is written completely, FALSE if writing has failed
+ */
+TR2DRAW_DLL BOOL StopCapture(void);
+
 #endif // TR2DRAW_H_INCLUDED
 
 /** @} */
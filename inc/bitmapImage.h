@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Bitmap image
+ *
+ * This file declares bitmap image wallpaper drawing
+ */
+
+/**
+ * @addtogroup BITMAP_IMAGE
+ *
+ * @{
+ */
+
+#ifndef BITMAPIMAGE_H_INCLUDED
+#define BITMAPIMAGE_H_INCLUDED
+
+#include "generalDraw.h"
+
+/// Number of the neighbouring image pixels stored around each image tile
+#define IMAGE_TILE_PADDING	(2)
+
+/**
+ * Sets bitmap image of the wallpaper. The pixels are copied, and the
+ * image is split into texture page tiles uploaded on the next draw.
+ * The tiles are kept until the image is changed, so it must be called
+ * only when the image is changed
+ * @param[in] pixels Image pixels (RGBA). NULL removes the image
+ * @param[in] width,height Image size (pixels)
+ * @param[in] pitch Number of pixels per image row
+ * @return TRUE if the image is set, FALSE if there is not enough memory
+ */
+BOOL setBitmapImage(const D3DCOLOR *pixels, int width, int height, int pitch);
+
+/**
+ * Marks the image tiles for reload (i.e. the device textures were lost).
+ * The tiles are uploaded to the same handles on the next draw. The upload
+ * is tried again even if it has failed before
+ */
+void invalidateBitmapImage(void);
+
+/**
+ * Frees bitmap image memory. The texture pages are not released, because
+ * the game may have released its textures already
+ */
+void freeBitmapImage(void);
+
+/**
+ * Draws bitmap image stretched to the game screen. The tiles are uploaded
+ * on the first draw after the image change, and the later draws only send
+ * one quad per tile. If the upload fails, it is not tried again until the
+ * image is changed or the tiles are invalidated
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @return TRUE if the image is drawn, FALSE if there is no image or the tiles cannot be uploaded
+ */
+BOOL drawBitmapImage(DRAWCONTEXT *dc, TR2CONTEXT *ctx);
+
+#endif // BITMAPIMAGE_H_INCLUDED
+
+/** @} */
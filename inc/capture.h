@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Device command capture and replay
+ *
+ * This file declares capture of the device command stream to the binary
+ * file, and replay of the captured file to any device implementation
+ */
+
+/**
+ * @addtogroup CAPTURE
+ *
+ * @{
+ */
+
+#ifndef CAPTURE_H_INCLUDED
+#define CAPTURE_H_INCLUDED
+
+#include "generalDraw.h"
+
+/// Capture file header magic ("TR2C")
+#define CAPTURE_MAGIC	(0x43325254)
+/// Capture file trailer magic ("TR2I")
+#define CAPTURE_INDEX_MAGIC	(0x49325254)
+/// Capture file format version
+#define CAPTURE_VERSION	(1)
+
+/// Capture record types
+typedef enum {
+	CRT_FRAME = 1,		///< Frame start. Payload is CAPTUREFRAME
+	CRT_RENDERSTATE = 2,	///< SetRenderState call. Payload is CAPTURESTATE
+	CRT_DRAW = 3,		///< DrawPrimitive call. Payload is CAPTUREDRAW followed by vertices
+	CRT_DRAWINDEXED = 4,	///< DrawIndexedPrimitive call. Payload is CAPTUREDRAW followed by vertices and indices
+	CRT_INDEX = 5,		///< Frame index. Payload is frame count followed by frame record offsets
+} CAPTURERECORDTYPE;
+
+/// Capture file header
+typedef struct {
+	DWORD magic;	///< CAPTURE_MAGIC
+	DWORD version;	///< CAPTURE_VERSION
+} CAPTUREHEADER;
+
+/// Capture record header. Records are 4 bytes aligned
+typedef struct {
+	DWORD type;	///< Record type (CAPTURERECORDTYPE)
+	DWORD size;	///< Payload size (bytes), multiple of 4
+} CAPTURERECORD;
+
+/// Capture frame record payload. It holds the context values of the frame
+typedef struct {
+	DWORD frame;		///< Frame number
+	DWORD prevOffset;	///< File offset of the previous frame record (0 for the first frame)
+	int screenWidth;	///< Screen width (pixels)
+	int screenHeight;	///< Screen height (pixels)
+	DWORD currentTextureHandle;	///< Current texture handle
+	DWORD currentAlphaState;	///< Current alpha state
+	DWORD alphaBlendAvailable;	///< AlphaBlend usage indicator
+	int textureMargin;	///< Texture margin factor
+	float rhwFactor;	///< rhw factor
+	float farZ;			///< Far Z coordinate
+	float farZ_normal;	///< Normalized far Z coordinate
+	float depthZ_normal;	///< Normalized Z depth
+} CAPTUREFRAME;
+
+/// Capture render state record payload
+typedef struct {
+	DWORD state;	///< Render state type
+	DWORD value;	///< Render state value
+} CAPTURESTATE;
+
+/// Capture draw record payload header
+typedef struct {
+	DWORD primitiveType;	///< Primitive type
+	DWORD vertexType;		///< Vertex type
+	DWORD vertexCount;		///< Number of vertices following the header
+	DWORD indexCount;		///< Number of indices following the vertices (padded to 4 bytes)
+	DWORD flags;			///< Draw flags
+} CAPTUREDRAW;
+
+/// Capture file trailer. It is written after the frame index when capture is stopped
+typedef struct {
+	DWORD magic;		///< CAPTURE_INDEX_MAGIC
+	DWORD indexOffset;	///< File offset of the frame index record
+} CAPTURETRAILER;
+
+/// Opened replay file (opaque)
+typedef struct REPLAY REPLAY;
+
+/**
+ * Starts capture of the device commands to the file
+ * @param[in] fileName Name of the capture file
+ * @return TRUE if the capture is started, FALSE otherwise
+ */
+BOOL startCapture(const char *fileName);
+
+/**
+ * Stops capture and writes the frame index
+ * @return TRUE if the capture file is written completely (or there is no capture), FALSE if writing has failed
+ */
+BOOL stopCapture(void);
+
+/**
+ * Checks if capture is active. The capture becomes inactive when writing
+ * to the file fails, but the file stays open until the capture is stopped
+ * @return TRUE if the capture is active, FALSE otherwise
+ */
+BOOL isCapturing(void);
+
+/**
+ * Writes frame record with the context values, and routes the device
+ * commands through the capture device
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @return Pointer to the context to be used for drawing of the frame
+ */
+TR2CONTEXT *captureFrame(TR2CONTEXT *ctx);
+
+/**
+ * Opens capture file for replay. The file is memory mapped
+ * @param[in] fileName Name of the capture file
+ * @return Pointer to the opened replay or NULL if the file is not valid
+ */
+REPLAY *openReplay(const char *fileName);
+
+/**
+ * Closes replay file
+ * @param[in] replay Pointer to the opened replay
+ */
+void closeReplay(REPLAY *replay);
+
+/**
+ * Gets number of captured frames
+ * @param[in] replay Pointer to the opened replay
+ * @return Number of frames
+ */
+int getReplayFrameCount(REPLAY *replay);
+
+/**
+ * Gets context values of the captured frame
+ * @param[in] replay Pointer to the opened replay
+ * @param[in] frame Frame number
+ * @return Pointer to the frame record payload or NULL if there is no such frame
+ */
+const CAPTUREFRAME *getReplayFrame(REPLAY *replay, int frame);
+
+/**
+ * Sends device commands of the captured frame to the device. The texture
+ * handle and alpha state applied by the game before the frame are sent first,
+ * so the frame may be replayed without the previous ones
+ * @param[in] replay Pointer to the opened replay
+ * @param[in] frame Frame number
+ * @param[in] device Pointer to the device object
+ * @return Number of commands sent, or -1 if there is no such frame
+ */
+int replayFrame(REPLAY *replay, int frame, LPDIRECT3DDEVICE2 *device);
+
+#endif // CAPTURE_H_INCLUDED
+
+/** @} */
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Draw statistics
+ *
+ * This file declares counters of the device work and the timing
+ * of the wallpaper paths
+ */
+
+/**
+ * @addtogroup DRAW_STATS
+ *
+ * @{
+ */
+
+#ifndef DRAWSTATS_H_INCLUDED
+#define DRAWSTATS_H_INCLUDED
+
+#include "winShim.h"
+
+/// Number of timed draw paths (one per wallpaper type)
+#define STATS_PATH_COUNT	(3)
+/// Number of the latest samples kept for each timed path
+#define STATS_HISTORY_SIZE	(256)
+
+/// Draw counters. The counters of one frame are limited to 32 bits
+typedef struct {
+	unsigned long long drawPrimitiveCount;	///< Number of DrawPrimitive/DrawIndexedPrimitive calls
+	unsigned long long vertexCount;			///< Number of vertices submitted
+	unsigned long long renderStateCount;	///< Number of SetRenderState calls issued
+	unsigned long long renderStateElided;	///< Number of render state changes elided (value already applied or overridden before the draw)
+	unsigned long long allocatedBytes;		///< Number of bytes allocated
+} DRAWCOUNTERS;
+
+/// CPU time of the draw path (microseconds) over the latest samples
+typedef struct {
+	DWORD sampleCount;	///< Number of samples (up to STATS_HISTORY_SIZE)
+	float minTime;		///< Minimum time
+	float avgTime;		///< Average time
+	float p99Time;		///< 99th percentile time
+	float lastTime;		///< Time of the latest sample
+} DRAWTIMING;
+
+/// Draw statistics
+typedef struct {
+	unsigned long long frameCount;	///< Number of frames since reset
+	DRAWCOUNTERS frame;	///< Counters of the latest frame
+	DRAWCOUNTERS total;	///< Counters since reset
+	DRAWTIMING timing[STATS_PATH_COUNT];	///< Timing of each draw path
+	unsigned long long arenaHighWater;	///< Maximum number of frame arena bytes used by one frame
+	unsigned long long arenaCapacity;	///< Number of bytes reserved by the frame arena
+} DRAWSTATS;
+
+/**
+ * Creates the statistics lock. It must be called before any other statistics function
+ */
+void initDrawStats(void);
+
+/**
+ * Deletes the statistics lock
+ */
+void freeDrawStats(void);
+
+/**
+ * Counts one draw call
+ * @param[in] vertexCount Number of vertices submitted
+ */
+void countDrawCall(DWORD vertexCount);
+
+/**
+ * Counts render state changes
+ * @param[in] issued Number of SetRenderState calls issued
+ * @param[in] elided Number of render state changes elided
+ */
+void countRenderStates(DWORD issued, DWORD elided);
+
+/**
+ * Counts memory allocation
+ * @param[in] size Number of bytes allocated
+ */
+void countAllocation(size_t size);
+
+/**
+ * Starts collection of the frame counters. The counters of the previous frame are added to the totals
+ */
+void beginStatsFrame(void);
+
+/**
+ * Reads the timer
+ * @return Timer value (ticks)
+ */
+long long getStatsTimer(void);
+
+/**
+ * Gets time elapsed since the timer value
+ * @param[in] startTime Timer value taken at the start
+ * @return Elapsed time (microseconds)
+ */
+float getStatsElapsed(long long startTime);
+
+/**
+ * Adds CPU time sample of the draw path
+ * @param[in] path Draw path index (0..STATS_PATH_COUNT-1)
+ * @param[in] startTime Timer value taken at the path start
+ */
+void addStatsTime(int path, long long startTime);
+
+/**
+ * Gets draw statistics
+ * @param[out] stats Pointer to the statistics structure
+ */
+void getDrawStats(DRAWSTATS *stats);
+
+/**
+ * Resets all counters and timing samples
+ */
+void resetDrawStats(void);
+
+#endif // DRAWSTATS_H_INCLUDED
+
+/** @} */
@@ -16,7 +16,7 @@
 #ifndef __DXTYPES_H__
 #define __DXTYPES_H__
 
-#include <windows.h>
+#include "winShim.h"
 
 /*
  * Wait until the device is ready to draw the primitive
@@ -290,8 +290,11 @@ typedef enum _D3DRENDERSTATETYPE {
 	D3DRENDERSTATE_FOGTABLEDENSITY    = 38,   /* Fog table density  */
 } D3DRENDERSTATETYPE;
 
+struct IDirect3DDevice2;
+
 typedef HRESULT __stdcall (*SET_RENDER_STATE)(struct IDirect3DDevice2**, D3DRENDERSTATETYPE, DWORD);
 typedef HRESULT __stdcall (*DRAW_PRIMITIVE)(struct IDirect3DDevice2**, D3DPRIMITIVETYPE, D3DVERTEXTYPE, LPVOID, DWORD, DWORD);
+typedef HRESULT __stdcall (*DRAW_INDEXED_PRIMITIVE)(struct IDirect3DDevice2**, D3DPRIMITIVETYPE, D3DVERTEXTYPE, LPVOID, DWORD, LPWORD, DWORD, DWORD);
 
 typedef struct IDirect3DDevice2 {
 	LPVOID QueryInterface;
@@ -324,7 +327,7 @@ typedef struct IDirect3DDevice2 {
 	LPVOID GetTransform;
 	LPVOID MultiplyTransform;
 	DRAW_PRIMITIVE DrawPrimitive;
-	LPVOID DrawIndexedPrimitive;
+	DRAW_INDEXED_PRIMITIVE DrawIndexedPrimitive;
 	LPVOID SetClipStatus;
 	LPVOID GetClipStatus;
 } *LPDIRECT3DDEVICE2;
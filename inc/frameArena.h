@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Frame arena
+ *
+ * This file declares arena allocator for the memory used within one frame
+ */
+
+/**
+ * @addtogroup FRAME_ARENA
+ *
+ * @{
+ */
+
+#ifndef FRAMEARENA_H_INCLUDED
+#define FRAMEARENA_H_INCLUDED
+
+#include "winShim.h"
+
+/// Alignment of the arena allocations (bytes)
+#define ARENA_ALIGNMENT	(64)
+/// Initial arena size (bytes)
+#define ARENA_INITIAL_SIZE	(64*1024)
+
+/// Arena memory block (opaque)
+typedef struct ARENABLOCK ARENABLOCK;
+
+/// Frame arena. It must be zero initialized before the first use
+typedef struct {
+	ARENABLOCK *currentBlock;	///< Current (last) block of the chain
+	size_t frameUsed;	///< Number of bytes used by the current frame
+	size_t highWater;	///< Maximum number of bytes used by one frame
+	size_t reserved;	///< Number of bytes reserved by all blocks
+} FRAMEARENA;
+
+/**
+ * Allocates memory valid until the next resetFrameArena() call
+ * @param[in,out] arena Pointer to the arena
+ * @param[in] size Number of bytes to allocate
+ * @return Pointer to ARENA_ALIGNMENT bytes aligned memory, or NULL if there is not enough memory
+ */
+void *arenaAlloc(FRAMEARENA *arena, size_t size);
+
+/**
+ * Releases all arena allocations. If the frame did not fit into the arena,
+ * the arena is replaced by one block large enough for the frame
+ * @param[in,out] arena Pointer to the arena
+ */
+void resetFrameArena(FRAMEARENA *arena);
+
+/**
+ * Frees arena memory
+ * @param[in,out] arena Pointer to the arena
+ */
+void releaseFrameArena(FRAMEARENA *arena);
+
+/**
+ * Gets memory usage of all arenas
+ * @param[out] highWaterSize Maximum number of bytes used by one frame of any arena
+ * @param[out] capacity Number of bytes reserved by all arenas
+ */
+void getFrameArenaUsage(size_t *highWaterSize, size_t *capacity);
+
+#endif // FRAMEARENA_H_INCLUDED
+
+/** @} */
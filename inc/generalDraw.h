@@ -57,6 +57,30 @@ typedef struct {
 	D3DCOLOR color; ///< Vertex color (RGBA)
 } VERTEX2D;
 
+/// Number of grid elements the column stride is rounded up to (32 bytes)
+#define GRID_STRIDE_ALIGN	(8)
+
+/// Grid of 2D vertices (structure of arrays). Vertex of column i and row j is stored at index i*stride+j
+typedef struct {
+	int countX;	///< Number of grid columns
+	int countY;	///< Number of grid rows
+	int stride;	///< Column stride (elements). It is countY rounded up to GRID_STRIDE_ALIGN
+	float *x;	///< Vertex X coordinates (pixels). 64 bytes aligned
+	float *y;	///< Vertex Y coordinates (pixels). 64 bytes aligned
+	D3DCOLOR *color;	///< Vertex colors (RGBA). 64 bytes aligned
+} GRID2D;
+
+/// Grid mesh: converted vertices and indices ready to be sent to the device
+typedef struct {
+	D3DTLVERTEX *vertices;	///< Vertices (32 bytes aligned)
+	int vertexCount;		///< Number of vertices
+	WORD *indices;			///< Triangle list indices
+	int indexCount;			///< Number of indices
+	DWORD textureHandle;	///< Texture handle
+	void *memory;	///< Allocated memory block
+	size_t capacity;	///< Size of the allocated memory block (bytes)
+} GRIDMESH;
+
 /// Texture data structure
 typedef struct {
 	DWORD handle; ///< Handle of texture tile
@@ -66,6 +90,76 @@ typedef struct {
 	int height;	///< Texture height (pixels)
 } TEXTURE;
 
+/// Frame constants derived from the Tomb Raider 2 Context structure
+typedef struct {
+	DWORD generation;	///< Generation counter. Changes whenever any of the values below is changed
+	int screenWidth;	///< Screen width (pixels)
+	int screenHeight;	///< Screen height (pixels)
+	int textureMargin;	///< Texture margin factor
+	float rhwFactor;	///< rhw factor
+	float farZ;			///< Far Z coordinate
+	float farZ_normal;	///< Normalized far Z coordinate
+	float depthZ_normal;	///< Normalized Z depth
+	float farRhw;		///< rhw at far Z coordinate
+	double halfPixel;	///< Texture margin in UV units
+} DRAWCONSTANTS;
+
+/// Draw context: draw batch, frame arena, cached index buffers and frame constants (opaque)
+typedef struct DRAWCONTEXT DRAWCONTEXT;
+
+/**
+ * Creates draw context. Each wallpaper instance draws through its own
+ * context, so different contexts may be used by different threads at once
+ * @return Pointer to the draw context, or NULL if there is not enough memory
+ */
+DRAWCONTEXT *createDrawContext(void);
+
+/**
+ * Frees draw context and its buffers
+ * @param[in] dc Pointer to the draw context. May be NULL
+ */
+void freeDrawContext(DRAWCONTEXT *dc);
+
+/**
+ * Starts drawing of a new frame. Takes the frame constants snapshot from
+ * the context and the render states applied by the game, and resets the
+ * frame arena. Must be called before any render function
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ */
+void beginDrawFrame(DRAWCONTEXT *dc, TR2CONTEXT *ctx);
+
+/**
+ * Takes the frame constants snapshot from the context. Used to switch the
+ * render target within the frame (the context of the target has its own
+ * screen size). The draw batch must be flushed before the switch
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ */
+void updateDrawConstants(DRAWCONTEXT *dc, TR2CONTEXT *ctx);
+
+/**
+ * Finishes drawing of the frame. Sends all queued primitives to the device
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ */
+void endDrawFrame(DRAWCONTEXT *dc, TR2CONTEXT *ctx);
+
+/**
+ * Gets frame constants snapshot taken by beginDrawFrame()
+ * @param[in] dc Pointer to the draw context
+ * @return Pointer to the frame constants
+ */
+const DRAWCONSTANTS *getDrawConstants(DRAWCONTEXT *dc);
+
+/**
+ * Compares frame constants values. The generation counters are not
+ * compared, so the snapshots of different draw contexts may be compared
+ * @param[in] a,b Pointers to the frame constants
+ * @return TRUE if the values are the same, FALSE otherwise
+ */
+BOOL isSameDrawConstants(const DRAWCONSTANTS *a, const DRAWCONSTANTS *b);
+
 /**
  * Converts gray value to full opaque RGBA gray color
  * @param[in] gray Gray value (0..255)
@@ -75,20 +169,121 @@ typedef struct {
 D3DCOLOR grayToRGBA(int gray, int inverted);
 
 /**
- * Draws flat colored untextured quad polygon (two triangles)
+ * Sends all quads collected in the draw batch to the device. Quads are
+ * collected while texture handle and alpha state remain unchanged, so
+ * this must be called before the game continues drawing by itself
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ */
+void flushDrawBatch(DRAWCONTEXT *dc, TR2CONTEXT *ctx);
+
+/**
+ * Allocates grid arrays in the frame arena. The grid is valid until the end of the frame
+ * @param[in,out] dc Pointer to the draw context
+ * @param[out] grid Pointer to the grid
+ * @param[in] countX Number of grid columns
+ * @param[in] countY Number of grid rows
+ * @return TRUE if the grid is ready, FALSE if there is not enough memory
+ */
+BOOL allocGrid(DRAWCONTEXT *dc, GRID2D *grid, int countX, int countY);
+
+/**
+ * Gets grid vertex as the Vertex structure
+ * @param[in] grid Pointer to the grid
+ * @param[in] i Grid column
+ * @param[in] j Grid row
+ * @param[out] vtx Pointer to the Vertex structure
+ */
+void getGridVertex(GRID2D *grid, int i, int j, VERTEX2D *vtx);
+
+/**
+ * Draws flat colored untextured quad polygon (two triangles).
+ * The quad is queued in the draw batch
+ * @param[in,out] dc Pointer to the draw context
  * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
  * @param[in] vtx0,vtx1,vtx2,vtx3 Pointers to the Vertex structures
  * @param[in] z Z coordinate for the polygon vertices
  */
-void renderColoredQuad(TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D *vtx2, VERTEX2D *vtx3, float z);
+void renderColoredQuad(DRAWCONTEXT *dc, TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D *vtx2, VERTEX2D *vtx3, float z);
 
 /**
- * Draws flat textured quad polygon (two triangles) at far Z coordinate
+ * Draws flat textured quad polygon (two triangles) at far Z coordinate.
+ * The quad is queued in the draw batch
+ * @param[in,out] dc Pointer to the draw context
  * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
  * @param[in] vtx0,vtx1,vtx2,vtx3 Pointers to the Vertex structures
  * @param[in] txr Pointer to the Texture structure
  */
-void renderTexturedFarQuad(TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D *vtx2, VERTEX2D *vtx3, TEXTURE *txr);
+void renderTexturedFarQuad(DRAWCONTEXT *dc, TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D *vtx2, VERTEX2D *vtx3, TEXTURE *txr);
+
+/**
+ * Draws flat colored untextured grid of quads. Each grid vertex is converted
+ * once and shared by the adjacent quads (indexed triangle list)
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] grid Pointer to the grid
+ * @param[in] z Z coordinate for the grid vertices
+ */
+void renderColoredGrid(DRAWCONTEXT *dc, TR2CONTEXT *ctx, GRID2D *grid, float z);
+
+/**
+ * Checks if the flat textured grid is drawn by one indexed draw call
+ * @param[in] countX Number of grid columns (vertices)
+ * @param[in] countY Number of grid rows (vertices)
+ * @param[in] detail Number of quads per texture tile
+ * @return TRUE if the grid is indexed, FALSE if it is drawn quad by quad
+ */
+BOOL isTexturedGridIndexed(int countX, int countY, int detail);
+
+/**
+ * Draws flat textured grid of quads at far Z coordinate. The texture is
+ * repeated every detail quads in both directions, so each quad maps to
+ * a 1/detail part of the texture. Each grid vertex is converted once and
+ * shared by the adjacent quads (indexed triangle list), except the inner
+ * edges of texture tiles, which are converted twice. Detail level 1 has
+ * no shared vertices, so it is drawn quad by quad, as well as the grids
+ * too large for one draw call
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] grid Pointer to the grid
+ * @param[in] txr Pointer to the Texture structure
+ * @param[in] detail Number of quads per texture tile
+ * @note The texture margins are applied to the outer edges of texture tiles
+ * only, so the texture is sampled continuously across the quads of one tile.
+ * The quads drawn one by one get the same texture coordinates as the indexed
+ * grid vertices
+ */
+void renderTexturedFarGrid(DRAWCONTEXT *dc, TR2CONTEXT *ctx, GRID2D *grid, TEXTURE *txr, int detail);
+
+/**
+ * Converts flat textured grid at far Z coordinate to the mesh, which may be
+ * drawn many times by renderGridMesh(). The mesh depends on the grid, the
+ * texture and the frame constants of the draw context. The mesh is indexed
+ * at any detail level, since it is converted once for many draws, and its
+ * texture margins are the same as of the indexed renderTexturedFarGrid()
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in,out] mesh Pointer to the mesh (zero initialized before the first call). Its memory is reused
+ * @param[in] grid Pointer to the grid
+ * @param[in] txr Pointer to the Texture structure
+ * @param[in] detail Number of quads per texture tile
+ * @return TRUE if the mesh is built, FALSE if the grid is too large for one draw call
+ * (it must be drawn by renderTexturedFarGrid() then) or there is not enough memory
+ */
+BOOL buildTexturedFarMesh(DRAWCONTEXT *dc, GRIDMESH *mesh, GRID2D *grid, TEXTURE *txr, int detail);
+
+/**
+ * Draws grid mesh built by buildTexturedFarMesh()
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] mesh Pointer to the mesh
+ */
+void renderGridMesh(DRAWCONTEXT *dc, TR2CONTEXT *ctx, GRIDMESH *mesh);
+
+/**
+ * Frees grid mesh memory
+ * @param[in,out] mesh Pointer to the mesh
+ */
+void freeGridMesh(GRIDMESH *mesh);
 
 #endif // GENERALDRAW_H_INCLUDED
 
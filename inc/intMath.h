@@ -34,17 +34,63 @@
 #ifndef INTMATH_H_INCLUDED
 #define INTMATH_H_INCLUDED
 
+#include "winShim.h"
+
+/// Sine table variants
+typedef enum {
+	ISV_NEAREST,	///< 0x401 entries quarter wave table, one entry per 16 angles (same as intSin())
+	ISV_LINEAR,		///< 0x401 entries quarter wave table with linear interpolation between the entries
+	ISV_QUARTER,	///< 0x4001 entries quarter wave table, one entry per angle (built on selection)
+	ISV_COUNT,		///< Number of variants
+} INTSINVARIANT;
+
+/// Divider by the loop invariant divisor. The division is replaced by the multiplication and the shifts
+typedef struct {
+	DWORD divisor;		///< Divisor
+	DWORD multiplier;	///< Reciprocal multiplier
+	int shift1;			///< First shift (0 or 1)
+	int shift2;			///< Second shift
+} DIVIDER;
+
 /**
  * Multiplies two 32-bit values and then divides the 64-bit result by a third
  * 32-bit value. The final result is rounded to the nearest integer.
+ * The product is 64-bit on any target, so it does not overflow
  * @param[in] number The multiplicand
  * @param[in] numerator The multiplier
  * @param[in] denominator The number by which the result of the multiplication operation is to be divided
  * @return The result of the multiplication and division, rounded to the nearest integer
- * @note The function always rounds the result as unsigned, it was done on purpose
+ * @note The function always rounds the result as unsigned, it was done on purpose.
+ * The products that fit 32 bits are rounded by the 32-bit unsigned remainder, so
+ * the results are the same as the 32-bit product ones, including the negative values
  */
 int mulDiv(int number, int numerator, int denominator);
 
+/**
+ * Prepares the divider by the divisor
+ * @param[out] divider Pointer to the divider
+ * @param[in] divisor The divisor. Must not be zero
+ */
+void initDivider(DIVIDER *divider, DWORD divisor);
+
+/**
+ * Divides unsigned 32-bit value by the divider divisor without the division instruction
+ * @param[in] divider Pointer to the divider
+ * @param[in] number The dividend
+ * @return The quotient rounded down. It is exact for any dividend
+ */
+DWORD divideBy(const DIVIDER *divider, DWORD number);
+
+/**
+ * Same as mulDiv() with the divider divisor as the denominator. The products
+ * that do not fit 32 bits are divided by the 64-bit division
+ * @param[in] number The multiplicand. Must not be negative
+ * @param[in] numerator The multiplier. Must not be negative
+ * @param[in] divider Pointer to the divider
+ * @return The result of the multiplication and division, rounded to the nearest integer
+ */
+int mulDivBy(int number, int numerator, const DIVIDER *divider);
+
 /**
  * Calculates sines of the angle integer representation
  * @param[in] angle Angle integer representation. It may be got from degrees with formula: (signed short)((float)D / 90.0 * (float)0x4000)
@@ -59,6 +105,61 @@ short intSin(unsigned short angle);
  */
 short intCos(unsigned short angle);
 
+/**
+ * Calculates sines of the angle integer representation by the table variant
+ * @param[in] angle Angle integer representation
+ * @param[in] variant Sine table variant. ISV_QUARTER falls back to ISV_NEAREST until it is selected by setIntSinVariant()
+ * @return Integer representation of sines
+ */
+short intSinVariant(unsigned short angle, INTSINVARIANT variant);
+
+/**
+ * Builds the full period sine table of intSinCosBatch() and intSinCosStrided()
+ * (64K entries). It must be called before the batch functions are used by
+ * several threads, otherwise the table is built by the first batch call
+ */
+void initIntMath(void);
+
+/**
+ * Selects sine table variant of intSinCosBatch() and intSinCosStrided().
+ * intSin() and intCos() always use ISV_NEAREST. The quarter wave table and
+ * the full period table are built here, so it must not be called while the
+ * batch functions are used by other threads
+ * @param[in] variant Sine table variant. Invalid value selects ISV_NEAREST
+ */
+void setIntSinVariant(INTSINVARIANT variant);
+
+/**
+ * Gets sine table variant of intSinCosBatch() and intSinCosStrided()
+ * @return Sine table variant
+ */
+INTSINVARIANT getIntSinVariant(void);
+
+/**
+ * Calculates sines and cosines of the angle array by the selected table
+ * variant. The values are gathered from the full period table, so the
+ * loops have no quadrant folding. With ISV_NEAREST the results are the
+ * same as intSin() and intCos() ones
+ * @param[in] angles Angle integer representations
+ * @param[out] sinOut Integer representations of sines. May be NULL
+ * @param[out] cosOut Integer representations of cosines. May be NULL
+ * @param[in] count Number of angles
+ */
+void intSinCosBatch(const unsigned short *angles, short *sinOut, short *cosOut, int count);
+
+/**
+ * Calculates sines and cosines of the angle sequence start, start+step,
+ * start+2*step... (the angles wrap around) by the selected table variant.
+ * The values are gathered from the full period table. With ISV_NEAREST the
+ * results are the same as intSin() and intCos() ones
+ * @param[in] start First angle integer representation
+ * @param[in] step Angle integer representation increment
+ * @param[out] sinOut Integer representations of sines. May be NULL
+ * @param[out] cosOut Integer representations of cosines. May be NULL
+ * @param[in] count Number of angles
+ */
+void intSinCosStrided(unsigned short start, unsigned short step, short *sinOut, short *cosOut, int count);
+
 #endif // INTMATH_H_INCLUDED
 
 /** @} */
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Render state cache
+ *
+ * This file declares shadow table of the device render states
+ */
+
+/**
+ * @addtogroup RENDER_STATE
+ *
+ * @{
+ */
+
+#ifndef RENDERSTATE_H_INCLUDED
+#define RENDERSTATE_H_INCLUDED
+
+#include "generalDraw.h"
+
+/// Number of render states in the shadow table (all D3DRENDERSTATETYPE values are below)
+#define RENDER_STATE_COUNT	(256)
+
+/**
+ * Records render state value. The state is marked dirty only if the value
+ * differs from the value applied to the device, so redundant changes cost nothing
+ * @param[in] state Render state type
+ * @param[in] value Render state value
+ */
+void setRenderState(D3DRENDERSTATETYPE state, DWORD value);
+
+/**
+ * Gets render state value recorded by setRenderState() or applied by the game
+ * @param[in] state Render state type
+ * @return Render state value
+ */
+DWORD getRenderState(D3DRENDERSTATETYPE state);
+
+/**
+ * Sends all dirty render states to the device. Must be called right before a draw.
+ * Texture handle and alpha state are also copied to the game variables
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ */
+void flushRenderStates(TR2CONTEXT *ctx);
+
+/**
+ * Takes texture handle and alpha state applied by the game from the game variables.
+ * Must be called when the game passes control to the library
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ */
+void importHostRenderStates(TR2CONTEXT *ctx);
+
+/**
+ * Records render state value applied to the device by the game
+ * @param[in] state Render state type
+ * @param[in] value Render state value
+ */
+void syncRenderState(D3DRENDERSTATETYPE state, DWORD value);
+
+/**
+ * Gets render state value applied to the device
+ * @param[in] state Render state type
+ * @param[out] value Pointer to the render state value
+ * @return TRUE if the applied value is known, FALSE otherwise
+ */
+BOOL getAppliedRenderState(D3DRENDERSTATETYPE state, DWORD *value);
+
+/**
+ * Forgets all applied render state values (i.e. when device is recreated).
+ * All recorded states will be sent to the device before the next draw
+ */
+void invalidateRenderStates(void);
+
+#endif // RENDERSTATE_H_INCLUDED
+
+/** @} */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Shared lock
+ *
+ * This file declares the lock of the state shared by all wallpaper instances
+ */
+
+/**
+ * @addtogroup SHARED_LOCK
+ *
+ * @{
+ */
+
+#ifndef SHAREDLOCK_H_INCLUDED
+#define SHAREDLOCK_H_INCLUDED
+
+#include "winShim.h"
+
+/**
+ * Creates the shared state lock. It must be called before the first draw
+ */
+void initSharedLock(void);
+
+/**
+ * Deletes the shared state lock
+ */
+void freeSharedLock(void);
+
+/**
+ * Locks the state shared by all wallpaper instances: render state shadow
+ * table, capture, texture pages and bitmap image. The device submissions are done under this lock too. The lock is
+ * recursive, so it may be taken again by the thread holding it
+ */
+void lockSharedState(void);
+
+/**
+ * Unlocks the state shared by all wallpaper instances
+ */
+void unlockSharedState(void);
+
+#endif // SHAREDLOCK_H_INCLUDED
+
+/** @} */
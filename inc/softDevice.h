@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Software device
+ *
+ * This file declares headless software rasterizer implementing
+ * IDirect3DDevice2 interface, and the context factory for it
+ */
+
+/**
+ * @addtogroup SOFT_DEVICE
+ *
+ * @{
+ */
+
+#ifndef SOFTDEVICE_H_INCLUDED
+#define SOFTDEVICE_H_INCLUDED
+
+#include "generalDraw.h"
+
+/// Texture page size (pixels)
+#define SOFT_PAGE_SIZE	(256)
+/// Maximum number of texture pages
+#define SOFT_MAX_PAGES	(64)
+/// Number of render states stored by the device
+#define SOFT_STATE_COUNT	(256)
+
+/// Software device structure
+typedef struct {
+	LPDIRECT3DDEVICE2 lpVtbl;	///< Device interface. It must be the first member
+	int width;		///< Frame buffer width (pixels)
+	int height;		///< Frame buffer height (pixels)
+	D3DCOLOR *frameBuffer;	///< Frame buffer (RGBA)
+	float *zBuffer;			///< Z buffer (normalized Z)
+	D3DCOLOR *pages[SOFT_MAX_PAGES];	///< Texture pages (RGBA). Texture handle is page index plus one
+	DWORD renderStates[SOFT_STATE_COUNT];	///< Current render states
+	DWORD setRenderStateCount;	///< Number of SetRenderState calls
+	DWORD drawPrimitiveCount;	///< Number of DrawPrimitive/DrawIndexedPrimitive calls
+	DWORD vertexCount;		///< Number of vertices submitted
+	DWORD triangleCount;	///< Number of triangles submitted
+} SOFTDEVICE;
+
+/// Software context structure. It holds the variables the Tomb Raider 2 Context points to
+typedef struct {
+	TR2CONTEXT ctx;		///< Tomb Raider 2 Context structure pointing to the members below
+	SOFTDEVICE *device;	///< Software device
+	LPDIRECT3DDEVICE2 *pDevice;	///< Device object pointer (ctx.pDxDevice points here)
+	int screenWidth;	///< Screen width (pixels)
+	int screenHeight;	///< Screen height (pixels)
+	DWORD currentTextureHandle;	///< Current texture handle
+	BYTE currentAlphaState;		///< Current alpha state
+	BYTE alphaBlendAvailable;	///< AlphaBlend usage indicator
+	int textureMargin;	///< Texture margin factor
+	float rhwFactor;	///< rhw factor
+	float farZ;			///< Far Z coordinate
+	float farZ_normal;	///< Normalized far Z coordinate
+	float depthZ_normal;	///< Normalized Z depth
+} SOFTCONTEXT;
+
+/**
+ * Creates software device with frame buffer and Z buffer. If the size is
+ * zero, the device only counts the calls (null device)
+ * @param[in] width Frame buffer width (pixels)
+ * @param[in] height Frame buffer height (pixels)
+ * @return Pointer to the created device or NULL if there is not enough memory
+ */
+SOFTDEVICE *createSoftDevice(int width, int height);
+
+/**
+ * Destroys software device and its texture pages
+ * @param[in] device Pointer to the software device
+ */
+void destroySoftDevice(SOFTDEVICE *device);
+
+/**
+ * Fills frame buffer and Z buffer
+ * @param[in] device Pointer to the software device
+ * @param[in] color Frame buffer color
+ * @param[in] z Z buffer value
+ */
+void clearSoftDevice(SOFTDEVICE *device, D3DCOLOR color, float z);
+
+/**
+ * Loads texture page to the software device
+ * @param[in] device Pointer to the software device
+ * @param[in] pixels Pointer to SOFT_PAGE_SIZE x SOFT_PAGE_SIZE RGBA pixels
+ * @return Texture handle or 0 if there is no free page
+ */
+DWORD loadSoftTexturePage(SOFTDEVICE *device, const D3DCOLOR *pixels);
+
+/**
+ * Calculates checksum of the frame buffer. Used for pixel-exact comparison
+ * @param[in] device Pointer to the software device
+ * @return FNV-1a hash of the frame buffer pixels
+ */
+DWORD getSoftDeviceChecksum(SOFTDEVICE *device);
+
+/**
+ * Saves frame buffer as binary PPM image
+ * @param[in] device Pointer to the software device
+ * @param[in] fileName Name of the image file
+ * @return TRUE if the image is saved, FALSE otherwise
+ */
+BOOL saveSoftDeviceImage(SOFTDEVICE *device, const char *fileName);
+
+/**
+ * Creates software device and the Tomb Raider 2 Context for it. Context
+ * values are set to the game defaults and may be changed via SOFTCONTEXT members
+ * @param[in] width Screen width (pixels)
+ * @param[in] height Screen height (pixels)
+ * @return Pointer to the created context or NULL if there is not enough memory
+ */
+SOFTCONTEXT *createSoftContext(int width, int height);
+
+/**
+ * Destroys software context and its device
+ * @param[in] soft Pointer to the software context
+ */
+void destroySoftContext(SOFTCONTEXT *soft);
+
+#endif // SOFTDEVICE_H_INCLUDED
+
+/** @} */
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Texture pages
+ *
+ * This file declares texture page upload through the game callbacks
+ */
+
+/**
+ * @addtogroup TEXTURE_PAGE
+ *
+ * @{
+ */
+
+#ifndef TEXTUREPAGE_H_INCLUDED
+#define TEXTUREPAGE_H_INCLUDED
+
+#include "dxTypes.h"
+
+/// Texture page size (pixels). TEXTURE coordinates and UV math are based on it
+#define TEXPAGE_SIZE	(256)
+
+/**
+ * Texture page upload callback. It is implemented by the game, because
+ * the textures are created by the game. The game converts the pixels to
+ * its texture format
+ * @param[in] pixels Page pixels (TEXPAGE_SIZE x TEXPAGE_SIZE, RGBA, TEXPAGE_SIZE pixels per row).
+ * NULL creates a page that may be set as render target (pixels are undefined)
+ * @param[in] handle Handle of the page to reload, or 0 to create a new page
+ * @return Texture handle of the page, or 0 if the page cannot be uploaded
+ */
+typedef DWORD (*TEXPAGEUPLOADFUNC)(const D3DCOLOR *pixels, DWORD handle);
+
+/**
+ * Texture page release callback. It is implemented by the game
+ * @param[in] handle Texture handle of the page
+ */
+typedef void (*TEXPAGERELEASEFUNC)(DWORD handle);
+
+/**
+ * Render target callback. It is implemented by the game, because the
+ * surfaces are owned by the game. The viewport must cover the whole target
+ * @param[in] handle Handle of the render target page to draw to, or 0 to
+ * restore the game render target
+ * @return TRUE if the render target is set, FALSE otherwise
+ */
+typedef BOOL (*TEXPAGETARGETFUNC)(DWORD handle);
+
+/**
+ * Render target creation callback. It is implemented by the game, because
+ * the surfaces are owned by the game. The target may be larger than
+ * requested (i.e. if the device supports power of two textures only)
+ * @param[in,out] width,height Requested target size (pixels). The size of the created target is returned
+ * @return Texture handle of the target, or 0 if the target cannot be created
+ */
+typedef DWORD (*TEXTARGETCREATEFUNC)(int *width, int *height);
+
+/**
+ * Sets texture page callbacks of the game
+ * @param[in] upload Upload callback. NULL disables the DLL-generated textures
+ * @param[in] release Release callback. May be NULL
+ */
+void setTexturePageCallbacks(TEXPAGEUPLOADFUNC upload, TEXPAGERELEASEFUNC release);
+
+/**
+ * Sets render target callback of the game
+ * @param[in] target Render target callback. NULL disables the render to texture
+ */
+void setTexturePageTargetCallback(TEXPAGETARGETFUNC target);
+
+/**
+ * Sets render target creation callback of the game
+ * @param[in] create Render target creation callback. NULL creates the render targets of the texture page size
+ */
+void setTargetCreateCallback(TEXTARGETCREATEFUNC create);
+
+/**
+ * Checks if the texture pages can be uploaded
+ * @return TRUE if the upload callback is set, FALSE otherwise
+ */
+BOOL isTexturePageAvailable(void);
+
+/**
+ * Uploads texture page through the game callback
+ * @param[in] pixels Page pixels (TEXPAGE_SIZE x TEXPAGE_SIZE, RGBA, TEXPAGE_SIZE pixels per row)
+ * @param[in] handle Handle of the page to reload, or 0 to create a new page
+ * @return Texture handle of the page, or 0 if the page cannot be uploaded
+ */
+DWORD uploadTexturePage(const D3DCOLOR *pixels, DWORD handle);
+
+/**
+ * Creates texture that may be set as render target. It is created by the
+ * render target creation callback if it is set, otherwise it is the texture page
+ * @param[in,out] width,height Requested target size (pixels). The size of the created target is returned
+ * @return Texture handle of the target, or 0 if render to texture is not available
+ */
+DWORD createTargetTexture(int *width, int *height);
+
+/**
+ * Sets render target through the game callback
+ * @param[in] handle Handle of the render target page, or 0 to restore the game render target
+ * @return TRUE if the render target is set, FALSE otherwise
+ */
+BOOL setTexturePageTarget(DWORD handle);
+
+/**
+ * Releases texture page through the game callback
+ * @param[in] handle Texture handle of the page. Zero is ignored
+ */
+void releaseTexturePage(DWORD handle);
+
+/**
+ * Copies image rectangle to the texture page together with the padding
+ * around it. The padding is filled with the neighbouring image pixels, so
+ * the filtering at the rectangle edges blends with the adjacent rectangles
+ * of the same image, and the edge pixels are repeated only outside the image
+ * @param[out] page Page pixels (TEXPAGE_SIZE x TEXPAGE_SIZE)
+ * @param[in] x,y Page coordinates of the rectangle (pixels). The padding around it must fit into the page
+ * @param[in] width,height Rectangle size (pixels)
+ * @param[in] pixels Image pixels
+ * @param[in] imageX,imageY Image coordinates of the rectangle (pixels). The rectangle must be inside the image
+ * @param[in] imageWidth,imageHeight Image size (pixels)
+ * @param[in] pitch Number of pixels per image row
+ * @param[in] padding Number of the pixels around the rectangle
+ */
+void copyToTexturePage(D3DCOLOR *page, int x, int y, int width, int height,
+					   const D3DCOLOR *pixels, int imageX, int imageY, int imageWidth, int imageHeight, int pitch, int padding);
+
+#endif // TEXTUREPAGE_H_INCLUDED
+
+/** @} */
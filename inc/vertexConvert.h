@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Vertex conversion
+ *
+ * This file declares bulk conversion of the 2D vertices to the
+ * transformed and lit vertices
+ */
+
+/**
+ * @addtogroup VERTEX_CONVERT
+ *
+ * @{
+ */
+
+#ifndef VERTEXCONVERT_H_INCLUDED
+#define VERTEXCONVERT_H_INCLUDED
+
+#include "generalDraw.h"
+
+/// Alignment of the vertex buffers passed to the vector kernels (bytes)
+#define VERTEX_ALIGNMENT	(32)
+
+/** @cond Doxygen_Suppress */
+#if defined(__GNUC__)
+#define VERTEX_ALIGNED __attribute__((aligned(VERTEX_ALIGNMENT)))
+#elif defined(_MSC_VER)
+#define VERTEX_ALIGNED __declspec(align(32))
+#else
+#define VERTEX_ALIGNED
+#endif
+/** @endcond */
+
+/**
+ * Converts 2D vertices (structure of arrays) to transformed and lit vertices.
+ * Screen coordinates and color are taken from the source vertex, all other values are taken
+ * from the pattern vertex. The vector kernel (AVX2 or SSE2) is selected at
+ * runtime; it is used if the output is VERTEX_ALIGNMENT bytes aligned
+ * @param[out] out Pointer to the output vertices
+ * @param[in] x Pointer to the source vertices X coordinates
+ * @param[in] y Pointer to the source vertices Y coordinates
+ * @param[in] color Pointer to the source vertices colors
+ * @param[in] source Source vertex index of each output vertex, or NULL if the source vertices are consecutive
+ * @param[in] pattern Pointer to the pattern vertices
+ * @param[in] patternStride Pattern vertex step per output vertex (0 means the same pattern for all vertices)
+ * @param[in] count Number of output vertices
+ */
+void convertVertices(D3DTLVERTEX *out, const float *x, const float *y, const D3DCOLOR *color, const int *source,
+					 const D3DTLVERTEX *pattern, int patternStride, int count);
+
+/**
+ * Gets name of the vertex conversion kernel selected for this CPU
+ * @return Kernel name ("avx2", "sse2" or "scalar")
+ */
+const char *getVertexKernelName(void);
+
+#endif // VERTEXCONVERT_H_INCLUDED
+
+/** @} */
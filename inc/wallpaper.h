@@ -35,16 +35,143 @@
 
 #include "generalDraw.h"
 
+#ifndef PATTERN_DETAIL
+/// Default animated pattern detail level (Increases the smoothness of the curve). It may be overridden at compile time
+#define PATTERN_DETAIL	(2)
+#endif // PATTERN_DETAIL
+
+/// Animated wallpaper clock. Wave phases are 16.16 fixed point angle integer representations
+typedef struct {
+	DWORD deformWavePhase;	///< Deformation wave phase
+	DWORD shortWavePhase;	///< Lighting short wave phase
+	DWORD longWavePhase;	///< Lighting long wave phase
+	long long lastTime;		///< Timestamp of the last advance (microseconds)
+	long long remainder;	///< Part of the elapsed time not converted to the phase yet (1/1000000 of 16.16 frame)
+	BOOL isTimeValid;		///< lastTime is set
+	int frameSpeed;			///< Framerate factor of the last frame advance
+	int frameRemainder;		///< Part of the frame advances not converted to the phase yet (1/frameSpeed of 16.16 frame)
+} WAVECLOCK;
+
+/// Initial state of the animated wallpaper clock (0, 90 and 225 degrees)
+#define WAVE_CLOCK_INITIALIZER	{0x0000u << 16, 0x4000u << 16, 0xA000u << 16, 0, 0, FALSE, 0, 0}
+
+/// Animated wallpaper styles
+typedef enum {
+	AWS_PATTERN = 0,	///< Deformed texture pattern (TR2 PlayStation inventory style)
+	AWS_PURERED = 1,	///< Undeformed pure red sheet (debug style)
+	AWS_CHART = 2,		///< Wave interference chart (debug style)
+	AWS_COUNT,			///< Number of the styles
+} ANIMSTYLE;
+
+/// Pattern wallpaper state (opaque). It holds the detail controller, the caches and the scratch
+/// buffers of the pattern wallpapers, so the draws with different states do not affect each other
+typedef struct PATTERNSTATE PATTERNSTATE;
+
+/**
+ * Creates pattern wallpaper state with the default parameters
+ * @return Pointer to the state, or NULL if there is not enough memory
+ */
+PATTERNSTATE *createPatternState(void);
+
+/**
+ * Frees pattern wallpaper state and its buffers
+ * @param[in] pattern Pointer to the state. May be NULL
+ */
+void freePatternState(PATTERNSTATE *pattern);
+
+/**
+ * Sets animated pattern detail level (number of quads per texture tile along each axis).
+ * If adaptive detail is enabled, it is the starting level
+ * @param[in,out] pattern Pointer to the pattern wallpaper state
+ * @param[in] detail Detail level. Zero or negative value restores the default PATTERN_DETAIL
+ */
+void setPatternDetail(PATTERNSTATE *pattern, int detail);
+
+/**
+ * Sets CPU time budget of the animated pattern. The detail level is lowered when the
+ * average cost of the pattern exceeds the budget, and raised when the next level fits it. The
+ * detail is not raised past the largest grid drawn by one indexed draw call
+ * @param[in,out] pattern Pointer to the pattern wallpaper state
+ * @param[in] budget Time budget per frame (microseconds). Zero disables adaptive detail, negative value restores the default PATTERN_TIME_BUDGET
+ */
+void setPatternTimeBudget(PATTERNSTATE *pattern, float budget);
+
+/**
+ * Gets animated pattern detail level
+ * @param[in] pattern Pointer to the pattern wallpaper state
+ * @return Detail level
+ */
+int getPatternDetail(PATTERNSTATE *pattern);
+
+/**
+ * Sets the wave phases to their initial values
+ * @param[out] clock Pointer to the animated wallpaper clock
+ */
+void resetWaveClock(WAVECLOCK *clock);
+
+/**
+ * Advances the wave phases by a part of the game frame (1/30 second)
+ * @param[in,out] clock Pointer to the animated wallpaper clock
+ * @param[in] frameSpeed Framerate factor. The phases are advanced by 1/frameSpeed of the game frame.
+ * The division remainder is carried to the next advance, so frameSpeed advances make one whole frame
+ */
+void advanceWaveClockFrame(WAVECLOCK *clock, int frameSpeed);
+
+/**
+ * Advances the wave phases to the timestamp. The elapsed time is converted exactly,
+ * so the phases do not drift at any frame rate
+ * @param[in,out] clock Pointer to the animated wallpaper clock
+ * @param[in] timestamp Monotonic timestamp (microseconds). The first call only sets the time origin
+ */
+void advanceWaveClockTime(WAVECLOCK *clock, long long timestamp);
+
+/**
+ * Draws animated wallpaper of the current style at the clock phases
+ * @param[in,out] pattern Pointer to the pattern wallpaper state
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] txr Pointer to the Texture structure
+ * @param[in] clock Pointer to the animated wallpaper clock
+ */
+void drawAnimatedWallpaperAt(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, WAVECLOCK *clock);
+
+/**
+ * Sets style of the animated wallpaper. The default style is AWS_PATTERN,
+ * or the debug one if DEBUG_WP_CHART or DEBUG_WP_PURERED is defined
+ * @param[in,out] pattern Pointer to the pattern wallpaper state
+ * @param[in] style Animated wallpaper style
+ */
+void setAnimatedStyle(PATTERNSTATE *pattern, ANIMSTYLE style);
+
+/**
+ * Draws animated wallpaper of the current style
+ * @param[in,out] pattern Pointer to the pattern wallpaper state
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] txr Pointer to the Texture structure
+ * @param[in] halfRowCount Half number of vertical rows of the wallpaper pattern
+ * @param[in] amplitude Percent value of the deformation amplitude (vertex rotation radius)
+ * @param[in] deformWavePhase Deformation wave phase in Integer representation
+ * @param[in] shortWavePhase Lighting short wave phase in Integer representation
+ * @param[in] longWavePhase Lighting long wave phase in Integer representation
+ */
+void drawAnimatedWallpaper(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int halfRowCount, unsigned char amplitude,
+						   short deformWavePhase, short shortWavePhase, short longWavePhase);
+
 /**
  * Draws static pattern wallpaper to the game screen (TR2 PC inventory style)
+ * @param[in,out] pattern Pointer to the pattern wallpaper state
+ * @param[in,out] dc Pointer to the draw context
  * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
  * @param[in] txr Pointer to the Texture structure
  * @param[in] rowCount Number of vertical rows of the wallpaper pattern
  */
-void drawStaticPattern(TR2CONTEXT *ctx, TEXTURE *txr, int rowCount);
+void drawStaticPattern(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int rowCount);
 
 /**
  * Draws animated pattern wallpaper (TR2 PlayStation inventory style)
+ * @param[in,out] pattern Pointer to the pattern wallpaper state
+ * @param[in,out] dc Pointer to the draw context
  * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
  * @param[in] txr Pointer to the Texture structure
  * @param[in] halfRowCount Half number of vertical rows of the wallpaper pattern
@@ -53,27 +180,29 @@ void drawStaticPattern(TR2CONTEXT *ctx, TEXTURE *txr, int rowCount);
  * @param[in] shortWavePhase Lighting short wave phase in Integer representation
  * @param[in] longWavePhase Lighting long wave phase in Integer representation
  */
-void drawAnimatedPattern(TR2CONTEXT *ctx, TEXTURE *txr, int halfRowCount, unsigned char amplitude,
+void drawAnimatedPattern(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int halfRowCount, unsigned char amplitude,
 						 short deformWavePhase, short shortWavePhase, short longWavePhase);
 
 /**
- * Draws animated undeformed pure red sheet wallpaper (requires DEBUG_WP_PURERED define)
+ * Draws animated undeformed pure red sheet wallpaper (AWS_PURERED debug style)
+ * @param[in,out] dc Pointer to the draw context
  * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
  * @param[in] halfRowCount Half number of vertical rows of the wallpaper pattern
  * @param[in] shortWavePhase Lighting short wave phase in Integer representation
  * @param[in] longWavePhase Lighting long wave phase in Integer representation
  */
-void drawAnimatedPureRed(TR2CONTEXT *ctx, int halfRowCount,
+void drawAnimatedPureRed(DRAWCONTEXT *dc, TR2CONTEXT *ctx, int halfRowCount,
 						 short shortWavePhase, short longWavePhase);
 
 /**
- * Draws animated wave interference chart wallpaper (requires DEBUG_WP_CHART define)
+ * Draws animated wave interference chart wallpaper (AWS_CHART debug style)
+ * @param[in,out] dc Pointer to the draw context
  * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
  * @param[in] halfRowCount Half number of vertical rows of the wallpaper pattern
  * @param[in] shortWavePhase Lighting short wave phase in Integer representation
  * @param[in] longWavePhase Lighting long wave phase in Integer representation
  */
-void drawAnimatedChart(TR2CONTEXT *ctx, int halfRowCount,
+void drawAnimatedChart(DRAWCONTEXT *dc, TR2CONTEXT *ctx, int halfRowCount,
 					   short shortWavePhase, short longWavePhase);
 
 #endif // WALLPAPER_H_INCLUDED
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Wallpaper cache
+ *
+ * This file declares render to texture cache of the wallpaper
+ */
+
+/**
+ * @addtogroup WALLPAPER_CACHE
+ *
+ * @{
+ */
+
+#ifndef WALLPAPERCACHE_H_INCLUDED
+#define WALLPAPERCACHE_H_INCLUDED
+
+#include "generalDraw.h"
+
+/// Default number of frames the animated wallpaper cache is used for before it is rendered again
+#define CACHE_ANIMATED_PERIOD	(2)
+
+/// Wallpaper cache (opaque). It holds one render target
+typedef struct WALLPAPERCACHE WALLPAPERCACHE;
+
+/**
+ * Wallpaper draw function
+ * @param[in] param Draw function parameter passed to drawCachedWallpaper()
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] txr Pointer to the Texture structure
+ */
+typedef void (*WALLPAPERFUNC)(void *param, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr);
+
+/**
+ * Creates disabled wallpaper cache. The render target is created on the first draw
+ * @return Pointer to the cache, or NULL if there is not enough memory
+ */
+WALLPAPERCACHE *createWallpaperCache(void);
+
+/**
+ * Frees wallpaper cache
+ * @param[in] cache Pointer to the cache. May be NULL
+ * @param[in] releasePage TRUE if the render target is released through the texture
+ * page callback, FALSE if the game may have released its textures already
+ */
+void freeWallpaperCache(WALLPAPERCACHE *cache, BOOL releasePage);
+
+/**
+ * Enables or disables the wallpaper cache
+ * @param[in,out] cache Pointer to the cache
+ * @param[in] enable TRUE if the wallpaper is rendered to the render target
+ * and drawn as one quad, FALSE if the wallpaper is drawn every frame
+ * @param[in] animatedPeriod Number of frames the animated wallpaper cache is
+ * used for. Zero or negative value restores the default
+ */
+void setWallpaperCache(WALLPAPERCACHE *cache, BOOL enable, int animatedPeriod);
+
+/**
+ * Marks the cache for rendering on the next draw (i.e. the wallpaper parameters are changed)
+ * @param[in,out] cache Pointer to the cache
+ */
+void invalidateWallpaperCache(WALLPAPERCACHE *cache);
+
+/**
+ * Marks all caches for rendering on their next draw (i.e. the textures are lost,
+ * or the global wallpaper parameters are changed). The render targets that
+ * have failed are tried again
+ */
+void invalidateWallpaperCaches(void);
+
+/**
+ * Draws wallpaper through the cache. The wallpaper is rendered to the render
+ * target when the cache is invalid, when the screen, the wallpaper type, the
+ * detail level or the texture is changed, and every animatedPeriod frames if
+ * the wallpaper is animated. Then the target is stretched to the screen by one
+ * far textured quad. The target is created for the screen size, so the cached
+ * wallpaper has the screen resolution, unless the game creates the texture
+ * page targets only (TEXPAGE_SIZE pixels along the longer side then). If the
+ * target cannot be created or set, the cache is not used until the caches are
+ * invalidated. The game render target is switched, so the cached draws hold
+ * the shared lock
+ * @param[in,out] cache Pointer to the cache
+ * @param[in,out] dc Pointer to the draw context
+ * @param[in] ctx Pointer to the Tomb Raider 2 Context structure
+ * @param[in] txr Pointer to the Texture structure
+ * @param[in] type Wallpaper type (cache key)
+ * @param[in] detail Wallpaper detail level (cache key)
+ * @param[in] isAnimated The flag indicates if the wallpaper is animated
+ * @param[in] func Wallpaper draw function
+ * @param[in] param Wallpaper draw function parameter
+ * @return TRUE if the wallpaper is drawn, FALSE if the cache is disabled or
+ * not available (the wallpaper must be drawn directly then)
+ */
+BOOL drawCachedWallpaper(WALLPAPERCACHE *cache, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int type, int detail,
+						 BOOL isAnimated, WALLPAPERFUNC func, void *param);
+
+#endif // WALLPAPERCACHE_H_INCLUDED
+
+/** @} */
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Windows types
+ *
+ * This file includes windows.h on Windows. On other platforms it declares
+ * the few Windows types and functions used by the library, so the renderer
+ * may be built and tested without the game (i.e. with software device)
+ *
+ * @cond Doxygen_Suppress
+ */
+
+#ifndef WINSHIM_H_INCLUDED
+#define WINSHIM_H_INCLUDED
+
+#ifdef _WIN32
+#include <windows.h>
+#else // _WIN32
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+// Windows types have fixed sizes: DWORD and LONG are 32-bit even if long is 64-bit
+typedef unsigned int	DWORD;
+typedef unsigned short	WORD;
+typedef unsigned char	BYTE;
+typedef int				LONG;
+typedef int				BOOL;
+typedef LONG			HRESULT;
+typedef void			*LPVOID;
+typedef WORD			*LPWORD;
+typedef void			*HINSTANCE;
+
+#define TRUE	(1)
+#define FALSE	(0)
+
+#define __stdcall
+#define __declspec(x)
+#define APIENTRY
+
+#define DLL_PROCESS_DETACH	(0)
+#define DLL_PROCESS_ATTACH	(1)
+#define DLL_THREAD_ATTACH	(2)
+#define DLL_THREAD_DETACH	(3)
+
+// Interlocked functions return the same values as on Windows
+static inline LONG InterlockedIncrement(volatile LONG *addend) {
+	return __sync_add_and_fetch(addend, 1);
+}
+
+static inline LONG InterlockedDecrement(volatile LONG *addend) {
+	return __sync_sub_and_fetch(addend, 1);
+}
+
+static inline LONG InterlockedExchangeAdd(volatile LONG *addend, LONG value) {
+	return __sync_fetch_and_add(addend, value);
+}
+
+static inline LONG InterlockedExchange(volatile LONG *target, LONG value) {
+	return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONG InterlockedCompareExchange(volatile LONG *destination, LONG exchange, LONG comparand) {
+	return __sync_val_compare_and_swap(destination, comparand, exchange);
+}
+
+// Critical section is recursive, as on Windows
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+static inline void InitializeCriticalSection(CRITICAL_SECTION *section) {
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(section, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+static inline void DeleteCriticalSection(CRITICAL_SECTION *section) {
+	pthread_mutex_destroy(section);
+}
+
+static inline void EnterCriticalSection(CRITICAL_SECTION *section) {
+	pthread_mutex_lock(section);
+}
+
+static inline void LeaveCriticalSection(CRITICAL_SECTION *section) {
+	pthread_mutex_unlock(section);
+}
+
+#endif // _WIN32
+
+#endif // WINSHIM_H_INCLUDED
+
+/** @endcond */
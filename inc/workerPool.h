@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Worker pool
+ *
+ * This file declares persistent worker thread pool for the grid generation
+ */
+
+/**
+ * @addtogroup WORKER_POOL
+ *
+ * @{
+ */
+
+#ifndef WORKERPOOL_H_INCLUDED
+#define WORKERPOOL_H_INCLUDED
+
+#include "winShim.h"
+
+/// Maximum number of worker threads
+#define WORKER_MAX	(8)
+/// Number of bands per participating thread (more bands give finer balancing)
+#define WORK_BANDS_PER_THREAD	(4)
+/// Time in milliseconds an idle worker thread waits for the work before it exits (Windows only)
+#define WORKER_IDLE_TIMEOUT	(1000)
+
+/**
+ * Work function. It must process items from begin to end (not including)
+ * and must not call the device or allocate frame memory
+ * @param[in] param Work parameter
+ * @param[in] begin First item
+ * @param[in] end Item after the last one
+ */
+typedef void (*WORKFUNC)(void *param, int begin, int end);
+
+/**
+ * Runs work function over the items split into bands. The calling thread
+ * processes bands too, and the threads that run out of bands steal them
+ * from the others. The pool is started on the first call. Small work is
+ * executed inline, as well as the work of a thread that finds the pool used
+ * by another thread
+ * @param[in] func Work function
+ * @param[in] param Work parameter
+ * @param[in] count Number of items
+ * @param[in] minBandSize Minimum number of items per band. Work of less than two bands is executed inline
+ */
+void runParallel(WORKFUNC func, void *param, int count, int minBandSize);
+
+/**
+ * Sets number of worker threads. The pool is restarted on the next runParallel() call.
+ * If another thread runs the work on the pool, it waits for the work to finish
+ * @param[in] count Number of worker threads. Zero executes all work inline, negative value restores the default (one less than the number of processors)
+ */
+void setWorkerCount(int count);
+
+/**
+ * Stops worker threads and waits for them to exit. If another thread runs
+ * the work on the pool, it waits for the work to finish first. It must not
+ * be called from DllMain, since the exiting threads wait for the loader
+ * lock. The library does not need it: the idle workers exit by themselves
+ */
+void stopWorkerPool(void);
+
+/**
+ * Releases the pool handles without waiting for the worker threads. It is
+ * called from DllMain on the library unloading, when the workers have exited
+ */
+void releaseWorkerPool(void);
+
+#endif // WORKERPOOL_H_INCLUDED
+
+/** @} */
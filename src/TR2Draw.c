@@ -32,44 +32,264 @@
  *
  * @{
  */
+#include <stdlib.h>
+#include "bitmapImage.h"
+#include "capture.h"
+#include "drawStats.h"
+#include "intMath.h"
+#include "renderState.h"
+#include "sharedLock.h"
+#include "texturePage.h"
 #include "wallpaper.h"
+#include "wallpaperCache.h"
+#include "workerPool.h"
 #include "TR2Draw.h"
 
-TR2DRAW_DLL void DrawWallpaper(TR2CONTEXT *ctx, TEXTURE *txr, WPTYPE wpType, int frameSpeed) {
-	static const int shortWaveStep = -0x0267; // minus 3.92 degrees
-	static const int longWaveStep  = -0x0200; // minus 2.81 degrees
+/// Wallpaper instance
+struct WALLPAPER {
+	WAVECLOCK clock;			///< Animated wallpaper clock
+	PATTERNSTATE *pattern;		///< Pattern wallpaper state
+	WALLPAPERCACHE *cache;		///< Wallpaper cache
+	DRAWCONTEXT *draw;			///< Draw context
+};
+
+/// Wallpaper instance of DrawWallpaper(), DrawWallpaperAt() and the wallpaper settings (created on first use)
+static WALLPAPER *defaultWallpaper = NULL;
+
+static void freeWallpaper(WALLPAPER *wallpaper, BOOL releasePages) {
+	if( wallpaper == NULL )
+		return;
+
+	freePatternState(wallpaper->pattern);
+	freeWallpaperCache(wallpaper->cache, releasePages);
+	freeDrawContext(wallpaper->draw);
+	free(wallpaper);
+}
 
-	static unsigned short deformWavePhase = 0x0000; // 0 degrees
-	static unsigned short shortWavePhase = 0x4000; // 90 degrees
-	static unsigned short longWavePhase = 0xA000; // 225 degrees
+static WALLPAPER *createWallpaper(void) {
+	WALLPAPER *wallpaper = calloc(1, sizeof(WALLPAPER));
 
+	if( wallpaper == NULL )
+		return NULL;
+
+	resetWaveClock(&wallpaper->clock);
+	wallpaper->pattern = createPatternState();
+	wallpaper->cache = createWallpaperCache();
+	wallpaper->draw = createDrawContext();
+	if( wallpaper->pattern == NULL || wallpaper->cache == NULL || wallpaper->draw == NULL ) {
+		freeWallpaper(wallpaper, FALSE);
+		return NULL;
+	}
+	return wallpaper;
+}
+
+static WALLPAPER *getDefaultWallpaper(void) {
+	lockSharedState();
+	if( defaultWallpaper == NULL )
+		defaultWallpaper = createWallpaper();
+	unlockSharedState();
+	return defaultWallpaper;
+}
+
+static void drawStaticWallpaper(void *param, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr) {
+	WALLPAPER *wallpaper = (WALLPAPER *)param;
+	drawStaticPattern(wallpaper->pattern, dc, ctx, txr, 6);
+}
+
+static void drawAnimatedWallpaperNow(void *param, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr) {
+	WALLPAPER *wallpaper = (WALLPAPER *)param;
+	drawAnimatedWallpaperAt(wallpaper->pattern, dc, ctx, txr, &wallpaper->clock);
+}
+
+static void drawWallpaper(WALLPAPER *wallpaper, TR2CONTEXT *ctx, TEXTURE *txr, WPTYPE wpType) {
+	DRAWCONTEXT *dc = wallpaper->draw;
+	long long startTime = getStatsTimer();
+
+	// the capture context is shared, so the captured draws are not concurrent
+	lockSharedState();
+	BOOL isExclusive = isCapturing();
+	ctx = captureFrame(ctx);
+	if( !isExclusive )
+		unlockSharedState();
+
+	beginDrawFrame(dc, ctx);
 	switch( wpType ) {
 		case WPT_IMAGE :
-//			drawBitmapImage(ctx);
+			drawBitmapImage(dc, ctx);
 			break;
 
 		case WPT_STATIC :
-			drawStaticPattern(ctx, txr, 6);
+			if( !drawCachedWallpaper(wallpaper->cache, dc, ctx, txr, wpType, 0, FALSE, drawStaticWallpaper, wallpaper) )
+				drawStaticWallpaper(wallpaper, dc, ctx, txr);
 			break;
 
 		case WPT_ANIMATED :
-#if defined DEBUG_WP_CHART
-			drawAnimatedChart(ctx, 3, shortWavePhase, longWavePhase);
-#elif defined DEBUG_WP_PURERED
-			drawAnimatedPureRed(ctx, 3, shortWavePhase, longWavePhase);
-#else
-			drawAnimatedPattern(ctx, txr, 3, 10, deformWavePhase, shortWavePhase, longWavePhase);
-#endif
-			if ( frameSpeed ) {
-				deformWavePhase += shortWaveStep / frameSpeed;
-				shortWavePhase  += shortWaveStep / frameSpeed;
-				longWavePhase   += longWaveStep  / frameSpeed;
-			}
+			if( !drawCachedWallpaper(wallpaper->cache, dc, ctx, txr, wpType, getPatternDetail(wallpaper->pattern),
+									 TRUE, drawAnimatedWallpaperNow, wallpaper) )
+				drawAnimatedWallpaperNow(wallpaper, dc, ctx, txr);
 			break;
 
 		default :
 			break;
 	}
+	endDrawFrame(dc, ctx);
+
+	if( isExclusive )
+		unlockSharedState();
+	addStatsTime(wpType, startTime);
+}
+
+TR2DRAW_DLL void DrawWallpaper(TR2CONTEXT *ctx, TEXTURE *txr, WPTYPE wpType, int frameSpeed) {
+	WALLPAPER *wallpaper = getDefaultWallpaper();
+
+	if( wallpaper == NULL )
+		return;
+
+	drawWallpaper(wallpaper, ctx, txr, wpType);
+	if( wpType == WPT_ANIMATED )
+		advanceWaveClockFrame(&wallpaper->clock, frameSpeed);
+}
+
+TR2DRAW_DLL void DrawWallpaperAt(TR2CONTEXT *ctx, TEXTURE *txr, WPTYPE wpType, long long timestamp) {
+	WALLPAPER *wallpaper = getDefaultWallpaper();
+
+	if( wallpaper == NULL )
+		return;
+
+	if( wpType == WPT_ANIMATED )
+		advanceWaveClockTime(&wallpaper->clock, timestamp);
+	drawWallpaper(wallpaper, ctx, txr, wpType);
+}
+
+TR2DRAW_DLL WALLPAPER *CreateWallpaper(void) {
+	return createWallpaper();
+}
+
+TR2DRAW_DLL void DestroyWallpaper(WALLPAPER *wallpaper) {
+	// the cache page is released through the shared texture page callback
+	lockSharedState();
+	freeWallpaper(wallpaper, TRUE);
+	unlockSharedState();
+}
+
+TR2DRAW_DLL void AdvanceWallpaper(WALLPAPER *wallpaper, int frameSpeed) {
+	if( wallpaper != NULL )
+		advanceWaveClockFrame(&wallpaper->clock, frameSpeed);
+}
+
+TR2DRAW_DLL void AdvanceWallpaperTo(WALLPAPER *wallpaper, long long timestamp) {
+	if( wallpaper != NULL )
+		advanceWaveClockTime(&wallpaper->clock, timestamp);
+}
+
+TR2DRAW_DLL void DrawWallpaperInstance(WALLPAPER *wallpaper, TR2CONTEXT *ctx, TEXTURE *txr, WPTYPE wpType) {
+	if( wallpaper != NULL )
+		drawWallpaper(wallpaper, ctx, txr, wpType);
+}
+
+TR2DRAW_DLL void SetTexturePageCallbacks(TEXPAGEUPLOADFUNC upload, TEXPAGERELEASEFUNC release) {
+	lockSharedState();
+	setTexturePageCallbacks(upload, release);
+	unlockSharedState();
+}
+
+TR2DRAW_DLL void SetRenderTargetCallback(TEXPAGETARGETFUNC target) {
+	lockSharedState();
+	setTexturePageTargetCallback(target);
+	unlockSharedState();
+	invalidateWallpaperCaches();
+}
+
+TR2DRAW_DLL void SetRenderTargetCreateCallback(TEXTARGETCREATEFUNC create) {
+	lockSharedState();
+	setTargetCreateCallback(create);
+	unlockSharedState();
+	invalidateWallpaperCaches();
+}
+
+TR2DRAW_DLL void SetWallpaperCache(BOOL enable, int animatedPeriod) {
+	WALLPAPER *wallpaper = getDefaultWallpaper();
+
+	if( wallpaper != NULL )
+		setWallpaperCache(wallpaper->cache, enable, animatedPeriod);
+}
+
+TR2DRAW_DLL BOOL SetWallpaperImage(const D3DCOLOR *pixels, int width, int height, int pitch) {
+	return setBitmapImage(pixels, width, height, pitch);
+}
+
+TR2DRAW_DLL void InvalidateTexturePages(void) {
+	invalidateBitmapImage();
+	invalidateWallpaperCaches();
+}
+
+TR2DRAW_DLL void SetWallpaperDetail(int detail) {
+	WALLPAPER *wallpaper = getDefaultWallpaper();
+
+	if( wallpaper == NULL )
+		return;
+
+	setPatternDetail(wallpaper->pattern, detail);
+	invalidateWallpaperCache(wallpaper->cache);
+}
+
+TR2DRAW_DLL void SetWallpaperTimeBudget(float budget) {
+	WALLPAPER *wallpaper = getDefaultWallpaper();
+
+	if( wallpaper == NULL )
+		return;
+
+	setPatternTimeBudget(wallpaper->pattern, budget);
+	invalidateWallpaperCache(wallpaper->cache);
+}
+
+TR2DRAW_DLL void SetWallpaperSineTable(int variant) {
+	setIntSinVariant(variant);
+	invalidateWallpaperCaches();
+}
+
+TR2DRAW_DLL void SyncRenderState(D3DRENDERSTATETYPE state, DWORD value) {
+	lockSharedState();
+	syncRenderState(state, value);
+	unlockSharedState();
+}
+
+TR2DRAW_DLL BOOL GetRenderState(D3DRENDERSTATETYPE state, DWORD *value) {
+	lockSharedState();
+	BOOL result = getAppliedRenderState(state, value);
+	unlockSharedState();
+	return result;
+}
+
+TR2DRAW_DLL void InvalidateRenderStates(void) {
+	lockSharedState();
+	invalidateRenderStates();
+	unlockSharedState();
+}
+
+TR2DRAW_DLL void GetDrawStats(DRAWSTATS *stats) {
+	getDrawStats(stats);
+}
+
+TR2DRAW_DLL void ResetDrawStats(void) {
+	resetDrawStats();
+}
+
+TR2DRAW_DLL BOOL StartCapture(const char *fileName) {
+	lockSharedState();
+	BOOL result = startCapture(fileName);
+	// the capture must be self-contained, so all render states are sent again
+	if( result )
+		invalidateRenderStates();
+	unlockSharedState();
+	return result;
+}
+
+TR2DRAW_DLL BOOL StopCapture(void) {
+	lockSharedState();
+	BOOL result = stopCapture();
+	unlockSharedState();
+	return result;
 }
 
 /**
@@ -86,10 +306,23 @@ extern TR2DRAW_DLL BOOL APIENTRY DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LP
 		case DLL_PROCESS_ATTACH :
 			// attach to process
 			// return FALSE to fail DLL load
+			initDrawStats();
+			initSharedLock();
+			initIntMath();
 			break;
 
 		case DLL_PROCESS_DETACH :
 			// detach from process
+			stopCapture();
+			freeBitmapImage();
+			// the game may have released its textures already, so the cache page is not released
+			freeWallpaper(defaultWallpaper, FALSE);
+			defaultWallpaper = NULL;
+			// the worker threads hold references to the library, so they have exited already
+			if( lpvReserved == NULL )
+				releaseWorkerPool();
+			freeSharedLock();
+			freeDrawStats();
 			break;
 
 		case DLL_THREAD_ATTACH :
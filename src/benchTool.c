@@ -0,0 +1,283 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Wallpaper benchmark tool
+ *
+ * This file implements command line tool measuring the wallpaper
+ * renderers against the null device across resolutions and detail levels
+ */
+
+/**
+ * @addtogroup DRAW_STATS
+ *
+ * @{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "drawStats.h"
+#include "intMath.h"
+#include "sharedLock.h"
+#include "softDevice.h"
+#include "wallpaper.h"
+#include "workerPool.h"
+
+/// Default number of animation frames per benchmark case
+#define BENCH_FRAMES	(2000)
+/// Maximum number of wallpaper instances drawn per frame
+#define BENCH_MAX_INSTANCES	(16)
+
+/// Wallpaper renderers measured by the benchmark
+typedef enum {
+	BENCH_STATIC,
+	BENCH_ANIMATED,
+	BENCH_PURERED,
+	BENCH_CHART,
+} BENCHPATTERN;
+
+/// Benchmark case
+typedef struct {
+	BENCHPATTERN pattern;	///< Wallpaper renderer
+	const char *name;	///< Renderer name
+	int rowCount;	///< Row count (static pattern) or half row count (animated patterns)
+	int detail;		///< Animated pattern detail level (0 if not applicable)
+} BENCHCASE;
+
+/// Benchmark screen resolution
+typedef struct {
+	int width;	///< Screen width (pixels)
+	int height;	///< Screen height (pixels)
+} BENCHSIZE;
+
+static const BENCHSIZE benchSizes[] = {
+	{640, 480}, {800, 600}, {1024, 768}, {1280, 720}, {1920, 1080},
+	{2560, 1440}, {3840, 2160}, {7680, 4320},
+};
+
+static const BENCHCASE benchCases[] = {
+	{BENCH_STATIC,   "static",   6,  0},
+	{BENCH_STATIC,   "static",   12, 0},
+	{BENCH_ANIMATED, "animated", 3,  1},
+	{BENCH_ANIMATED, "animated", 3,  2},
+	{BENCH_ANIMATED, "animated", 3,  4},
+	{BENCH_ANIMATED, "animated", 6,  2},
+	{BENCH_ANIMATED, "animated", 6,  4},
+	{BENCH_ANIMATED, "animated", 12, 4},
+	{BENCH_PURERED,  "purered",  3,  0},
+	{BENCH_PURERED,  "purered",  6,  0},
+	{BENCH_CHART,    "chart",    3,  0},
+	{BENCH_CHART,    "chart",    6,  0},
+};
+
+#ifdef _WIN32
+static double getSeconds(void) {
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+#else // _WIN32
+#include <time.h>
+static double getSeconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+#endif // _WIN32
+
+/// Pattern wallpaper states of the independent instances
+static PATTERNSTATE *patterns[BENCH_MAX_INSTANCES];
+/// Number of wallpaper instances drawn per frame
+static int patternCount = 1;
+/// Draw context shared by the instances, as they are drawn to one screen
+static DRAWCONTEXT *drawContext;
+
+// draws one frame of the case with the same phase steps as DrawWallpaper. Each instance is one frame ahead of the previous one
+static void drawBenchFrame(SOFTCONTEXT *soft, const BENCHCASE *bench, TEXTURE *txr, int frame) {
+	TR2CONTEXT *ctx = &soft->ctx;
+	DRAWCONTEXT *dc = drawContext;
+
+	beginDrawFrame(dc, ctx);
+	for( int i=0; i<patternCount; ++i ) {
+		short deformWavePhase = 0x0000 - 0x0267*(frame+i);
+		short shortWavePhase = 0x4000 - 0x0267*(frame+i);
+		short longWavePhase = 0xA000 - 0x0200*(frame+i);
+
+		switch( bench->pattern ) {
+			case BENCH_STATIC :
+				drawStaticPattern(patterns[i], dc, ctx, txr, bench->rowCount);
+				break;
+			case BENCH_ANIMATED :
+				drawAnimatedPattern(patterns[i], dc, ctx, txr, bench->rowCount, 10, deformWavePhase, shortWavePhase, longWavePhase);
+				break;
+			case BENCH_PURERED :
+				drawAnimatedPureRed(dc, ctx, bench->rowCount, shortWavePhase, longWavePhase);
+				break;
+			case BENCH_CHART :
+				drawAnimatedChart(dc, ctx, bench->rowCount, shortWavePhase, longWavePhase);
+				break;
+		}
+	}
+	endDrawFrame(dc, ctx);
+}
+
+static void runBenchCase(SOFTCONTEXT *soft, const BENCHSIZE *size, const BENCHCASE *bench, int frameCount, BOOL json, BOOL *first) {
+	TEXTURE txr = {1, 0, 0, 64, 64};
+	DRAWSTATS stats;
+
+	soft->screenWidth = size->width;
+	soft->screenHeight = size->height;
+	for( int i=0; i<patternCount && bench->detail > 0; ++i )
+		setPatternDetail(patterns[i], bench->detail);
+
+	// warm up caches before the measurement
+	for( int i=0; i<16; ++i )
+		drawBenchFrame(soft, bench, &txr, i);
+
+	resetDrawStats();
+	double startTime = getSeconds();
+	for( int i=0; i<frameCount; ++i )
+		drawBenchFrame(soft, bench, &txr, i);
+	double elapsed = getSeconds() - startTime;
+	getDrawStats(&stats);
+	for( int i=0; i<patternCount; ++i )
+		setPatternDetail(patterns[i], 0);
+
+	double nsPerFrame = elapsed * 1e9 / frameCount;
+	double vertices = (double)stats.total.vertexCount / frameCount;
+	double nsPerVertex = ( vertices > 0.0 ) ? nsPerFrame / vertices : 0.0;
+	double drawCalls = (double)stats.total.drawPrimitiveCount / frameCount;
+	double stateCalls = (double)stats.total.renderStateCount / frameCount;
+	double allocBytes = (double)stats.total.allocatedBytes / frameCount;
+
+	if( json ) {
+		printf("%s{\"pattern\":\"%s\",\"width\":%d,\"height\":%d,\"rows\":%d,\"detail\":%d,\"frames\":%d,"
+			   "\"ns_per_frame\":%.1f,\"ns_per_vertex\":%.2f,\"vertices\":%.1f,\"draw_calls\":%.2f,"
+			   "\"state_calls\":%.2f,\"alloc_bytes\":%.1f,\"instances\":%d}",
+			   *first ? "[\n" : ",\n", bench->name, size->width, size->height, bench->rowCount, bench->detail, frameCount,
+			   nsPerFrame, nsPerVertex, vertices, drawCalls, stateCalls, allocBytes, patternCount);
+	} else {
+		printf("%s,%d,%d,%d,%d,%d,%.1f,%.2f,%.1f,%.2f,%.2f,%.1f,%d\n",
+			   bench->name, size->width, size->height, bench->rowCount, bench->detail, frameCount,
+			   nsPerFrame, nsPerVertex, vertices, drawCalls, stateCalls, allocBytes, patternCount);
+	}
+	*first = FALSE;
+}
+
+static void printUsage(void) {
+	printf("Usage: tr2bench [options]\n"
+		   "  -frames N    animation frames per case (default: %d)\n"
+		   "  -pattern P   run only static, animated, purered or chart cases\n"
+		   "  -size WxH    run only the given resolution\n"
+		   "  -sine N      sine table variant of the wave tables (0 nearest, 1 linear, 2 quarter)\n"
+		   "  -threads N   number of worker threads (0 generates grids inline)\n"
+		   "  -instances N number of independent wallpaper instances drawn per frame (1..%d)\n"
+		   "  -json        print JSON array instead of CSV\n", BENCH_FRAMES, BENCH_MAX_INSTANCES);
+}
+
+int main(int argc, char *argv[]) {
+	int frameCount = BENCH_FRAMES;
+	const char *pattern = NULL;
+	BENCHSIZE customSize = {0, 0};
+	BOOL json = FALSE;
+	BOOL first = TRUE;
+
+	for( int i=1; i<argc; ++i ) {
+		if( !strcmp(argv[i], "-frames") && i+1 < argc )
+			frameCount = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-pattern") && i+1 < argc )
+			pattern = argv[++i];
+		else if( !strcmp(argv[i], "-size") && i+1 < argc && sscanf(argv[i+1], "%dx%d", &customSize.width, &customSize.height) == 2 )
+			++i;
+		else if( !strcmp(argv[i], "-sine") && i+1 < argc )
+			setIntSinVariant(atoi(argv[++i]));
+		else if( !strcmp(argv[i], "-threads") && i+1 < argc )
+			setWorkerCount(atoi(argv[++i]));
+		else if( !strcmp(argv[i], "-instances") && i+1 < argc )
+			patternCount = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-json") )
+			json = TRUE;
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+	if( frameCount <= 0 || patternCount <= 0 || patternCount > BENCH_MAX_INSTANCES ) {
+		printUsage();
+		return 1;
+	}
+
+	initDrawStats();
+	initSharedLock();
+	initIntMath();
+
+	for( int i=0; i<patternCount; ++i ) {
+		patterns[i] = createPatternState();
+		if( patterns[i] == NULL ) {
+			fprintf(stderr, "Cannot create wallpaper instance\n");
+			return 1;
+		}
+		// the cases measure fixed detail levels
+		setPatternTimeBudget(patterns[i], 0.0f);
+	}
+
+	drawContext = createDrawContext();
+	if( drawContext == NULL ) {
+		fprintf(stderr, "Cannot create draw context\n");
+		return 1;
+	}
+
+	// null device: the renderers are measured without rasterization
+	SOFTCONTEXT *soft = createSoftContext(0, 0);
+	if( soft == NULL ) {
+		fprintf(stderr, "Cannot create device\n");
+		return 1;
+	}
+
+	if( !json )
+		printf("pattern,width,height,rows,detail,frames,ns_per_frame,ns_per_vertex,vertices,draw_calls,state_calls,alloc_bytes,instances\n");
+
+	for( unsigned i=0; i<sizeof(benchCases)/sizeof(benchCases[0]); ++i ) {
+		if( pattern != NULL && strcmp(pattern, benchCases[i].name) )
+			continue;
+
+		if( customSize.width > 0 && customSize.height > 0 ) {
+			runBenchCase(soft, &customSize, &benchCases[i], frameCount, json, &first);
+			continue;
+		}
+		for( unsigned j=0; j<sizeof(benchSizes)/sizeof(benchSizes[0]); ++j )
+			runBenchCase(soft, &benchSizes[j], &benchCases[i], frameCount, json, &first);
+	}
+
+	if( json )
+		printf("%s]\n", first ? "[\n" : "\n");
+
+	destroySoftContext(soft);
+	for( int i=0; i<patternCount; ++i )
+		freePatternState(patterns[i]);
+	freeDrawContext(drawContext);
+	stopWorkerPool();
+	freeSharedLock();
+	freeDrawStats();
+	return 0;
+}
+
+/** @} */
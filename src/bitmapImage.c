@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Bitmap image
+ *
+ * This file implements bitmap image wallpaper drawing
+ */
+
+/**
+ * @defgroup BITMAP_IMAGE Bitmap image
+ * @brief Bitmap image wallpaper
+ *
+ * This module contains the bitmap image wallpaper (title, credits and
+ * TR1/TR3 styled inventory). The image is split into the tiles of one
+ * texture page each, and the tiles are uploaded through the game once.
+ * Each frame the tiles are drawn as far textured quads stretched to the
+ * game screen, so the cost of the image is just the draw submission.
+ * The image is shared by all wallpaper instances, so it is used under
+ * the shared lock
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bitmapImage.h"
+#include "drawStats.h"
+#include "sharedLock.h"
+#include "texturePage.h"
+
+/// Size of the image area stored in one tile (pixels)
+#define IMAGE_TILE_SIZE	(TEXPAGE_SIZE - IMAGE_TILE_PADDING*2)
+
+/// Bitmap image tile
+typedef struct {
+	TEXTURE txr;	///< Tile texture. Handle is 0 until the tile is uploaded
+	int x;	///< Image X coordinate of the tile (pixels)
+	int y;	///< Image Y coordinate of the tile (pixels)
+} IMAGETILE;
+
+/// Bitmap image split into tiles
+typedef struct {
+	int width;	///< Image width (pixels)
+	int height;	///< Image height (pixels)
+	D3DCOLOR *pixels;	///< Image pixels (width pixels per row)
+	int tileCountX;	///< Number of tile columns
+	int tileCountY;	///< Number of tile rows
+	IMAGETILE *tiles;	///< Tiles (row by row)
+	BOOL isUploaded;	///< All tiles are uploaded
+	BOOL isUploadFailed;	///< Tile upload has failed. It is not retried until the tiles are invalidated
+} BITMAPIMAGE;
+
+/// Current wallpaper image
+static BITMAPIMAGE image;
+
+// releases tile pages and frees image memory
+static void clearBitmapImage(BOOL releasePages) {
+	if( releasePages && image.tiles != NULL ) {
+		for( int i=0; i<image.tileCountX*image.tileCountY; ++i )
+			releaseTexturePage(image.tiles[i].txr.handle);
+	}
+	free(image.tiles);
+	free(image.pixels);
+	memset(&image, 0, sizeof(image));
+}
+
+// uploads all tiles of the image, returns FALSE if any tile cannot be uploaded
+static BOOL uploadBitmapImage(void) {
+	D3DCOLOR *page = malloc(sizeof(D3DCOLOR) * TEXPAGE_SIZE * TEXPAGE_SIZE);
+	BOOL result = TRUE;
+
+	if( page == NULL )
+		return FALSE;
+	countAllocation(sizeof(D3DCOLOR) * TEXPAGE_SIZE * TEXPAGE_SIZE);
+
+	for( int i=0; i<image.tileCountX*image.tileCountY; ++i ) {
+		IMAGETILE *tile = &image.tiles[i];
+		copyToTexturePage(page, tile->txr.x, tile->txr.y, tile->txr.width, tile->txr.height,
+						  image.pixels, tile->x, tile->y, image.width, image.height, image.width, IMAGE_TILE_PADDING);
+		DWORD handle = uploadTexturePage(page, tile->txr.handle);
+		if( handle == 0 ) {
+			result = FALSE;
+			break;
+		}
+		tile->txr.handle = handle;
+	}
+	free(page);
+	return result;
+}
+
+static BOOL storeBitmapImage(const D3DCOLOR *pixels, int width, int height, int pitch) {
+	clearBitmapImage(TRUE);
+	if( pixels == NULL || width <= 0 || height <= 0 )
+		return TRUE;
+
+	int tileCountX = (width  + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+	int tileCountY = (height + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+
+	image.pixels = malloc(sizeof(D3DCOLOR) * width * height);
+	image.tiles = calloc(tileCountX * tileCountY, sizeof(IMAGETILE));
+	if( image.pixels == NULL || image.tiles == NULL ) {
+		clearBitmapImage(FALSE);
+		return FALSE;
+	}
+	countAllocation(sizeof(D3DCOLOR) * width * height + sizeof(IMAGETILE) * tileCountX * tileCountY);
+
+	for( int j=0; j<height; ++j )
+		memcpy(image.pixels + j * width, pixels + j * pitch, sizeof(D3DCOLOR) * width);
+
+	image.width = width;
+	image.height = height;
+	image.tileCountX = tileCountX;
+	image.tileCountY = tileCountY;
+	for( int j=0; j<tileCountY; ++j ) {
+		for( int i=0; i<tileCountX; ++i ) {
+			IMAGETILE *tile = &image.tiles[j * tileCountX + i];
+			tile->x = i * IMAGE_TILE_SIZE;
+			tile->y = j * IMAGE_TILE_SIZE;
+			tile->txr.x = IMAGE_TILE_PADDING;
+			tile->txr.y = IMAGE_TILE_PADDING;
+			tile->txr.width  = ( width  - tile->x < IMAGE_TILE_SIZE ) ? width  - tile->x : IMAGE_TILE_SIZE;
+			tile->txr.height = ( height - tile->y < IMAGE_TILE_SIZE ) ? height - tile->y : IMAGE_TILE_SIZE;
+		}
+	}
+	return TRUE;
+}
+
+BOOL setBitmapImage(const D3DCOLOR *pixels, int width, int height, int pitch) {
+	lockSharedState();
+	BOOL result = storeBitmapImage(pixels, width, height, pitch);
+	unlockSharedState();
+	return result;
+}
+
+void invalidateBitmapImage(void) {
+	lockSharedState();
+	image.isUploaded = FALSE;
+	image.isUploadFailed = FALSE;
+	unlockSharedState();
+}
+
+void freeBitmapImage(void) {
+	lockSharedState();
+	clearBitmapImage(FALSE);
+	unlockSharedState();
+}
+
+// queues the tile quads stretched to the screen
+static BOOL renderBitmapImage(DRAWCONTEXT *dc, TR2CONTEXT *ctx) {
+	if( image.tiles == NULL || image.isUploadFailed || !isTexturePageAvailable() )
+		return FALSE;
+
+	if( !image.isUploaded ) {
+		// the game may use the device while uploading
+		flushDrawBatch(dc, ctx);
+		image.isUploaded = uploadBitmapImage();
+		if( !image.isUploaded ) {
+			image.isUploadFailed = TRUE;
+			return FALSE;
+		}
+	}
+
+	const DRAWCONSTANTS *constants = getDrawConstants(dc);
+	float scaleX = (float)constants->screenWidth  / (float)image.width;
+	float scaleY = (float)constants->screenHeight / (float)image.height;
+	D3DCOLOR color = grayToRGBA(255, FALSE);
+
+	for( int i=0; i<image.tileCountX*image.tileCountY; ++i ) {
+		IMAGETILE *tile = &image.tiles[i];
+		float x0 = (float)tile->x * scaleX;
+		float y0 = (float)tile->y * scaleY;
+		float x1 = (float)(tile->x + tile->txr.width)  * scaleX;
+		float y1 = (float)(tile->y + tile->txr.height) * scaleY;
+		VERTEX2D vtx[4] = {
+			{x0, y0, color},
+			{x1, y0, color},
+			{x0, y1, color},
+			{x1, y1, color},
+		};
+		renderTexturedFarQuad(dc, ctx, &vtx[0], &vtx[1], &vtx[2], &vtx[3], &tile->txr);
+	}
+	return TRUE;
+}
+
+BOOL drawBitmapImage(DRAWCONTEXT *dc, TR2CONTEXT *ctx) {
+	lockSharedState();
+	BOOL result = renderBitmapImage(dc, ctx);
+	unlockSharedState();
+	return result;
+}
+
+/** @} */
@@ -0,0 +1,448 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Device command capture and replay
+ *
+ * This file implements capture of the device command stream to the binary
+ * file, and replay of the captured file to any device implementation
+ */
+
+/**
+ * @defgroup CAPTURE Capture
+ * @brief Device command capture and replay
+ *
+ * This module contains the capture device, which records all commands
+ * sent by the library to the game device, and the replay, which sends
+ * the recorded commands to any device. The capture file is append-only:
+ * header, then records. Every frame starts with the frame record holding
+ * the context values and the offset of the previous frame record. When the
+ * capture is stopped, the frame index and the trailer are appended, so the
+ * replay may seek to any frame directly. If the capture was not stopped
+ * properly, the replay rebuilds the index by scanning the records
+ *
+ * @{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "capture.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // _WIN32
+
+/// Size of each captured vertex (all DX5 vertex types have the same size)
+#define CAPTURE_VERTEX_SIZE	(sizeof(D3DTLVERTEX))
+
+/// Capture state
+typedef struct {
+	LPDIRECT3DDEVICE2 lpVtbl;	///< Capture device interface. It must be the first member
+	LPDIRECT3DDEVICE2 **pGameDevice;	///< Pointer to the game device object
+	FILE *fp;				///< Capture file
+	DWORD offset;			///< Current file offset
+	DWORD frameCount;		///< Number of captured frames
+	DWORD *frameOffsets;	///< File offsets of the frame records
+	DWORD frameCapacity;	///< Capacity of the frame offsets array
+	LPDIRECT3DDEVICE2 *device;	///< Capture device object pointer
+	TR2CONTEXT ctx;			///< Context routed through the capture device
+	BOOL isWriteFailed;		///< Writing to the capture file has failed. Nothing is written after it
+} CAPTURE;
+
+/// Opened replay file
+struct REPLAY {
+	const BYTE *data;	///< Mapped file data
+	DWORD size;			///< File size (bytes)
+	int frameCount;		///< Number of frames
+	DWORD *frameOffsets;	///< File offsets of the frame records
+#ifdef _WIN32
+	HANDLE file;		///< File handle
+	HANDLE mapping;		///< File mapping handle
+#endif // _WIN32
+};
+
+static HRESULT __stdcall captureSetRenderState(struct IDirect3DDevice2 **This, D3DRENDERSTATETYPE state, DWORD value);
+static HRESULT __stdcall captureDrawPrimitive(struct IDirect3DDevice2 **This, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType,
+											  LPVOID vertices, DWORD vertexCount, DWORD flags);
+static HRESULT __stdcall captureDrawIndexedPrimitive(struct IDirect3DDevice2 **This, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType,
+													 LPVOID vertices, DWORD vertexCount, LPWORD indices, DWORD indexCount, DWORD flags);
+
+/// Capture device interface. Only the methods used by the library are intercepted
+static struct IDirect3DDevice2 captureDeviceInterface = {
+	.SetRenderState = captureSetRenderState,
+	.DrawPrimitive = captureDrawPrimitive,
+	.DrawIndexedPrimitive = captureDrawIndexedPrimitive,
+};
+
+static CAPTURE capture;
+
+static DWORD alignSize(DWORD size) {
+	return (size + 3) & ~3u;
+}
+
+// writes data padded to 4 bytes. After the first failure nothing is written, so the file is not corrupted further
+static void writeData(CAPTURE *cap, const void *data, DWORD size) {
+	static const BYTE padding[4] = {0, 0, 0, 0};
+	DWORD paddingSize = alignSize(size) - size;
+
+	if( cap->isWriteFailed )
+		return;
+
+	if( fwrite(data, 1, size, cap->fp) != size
+		|| (paddingSize && fwrite(padding, 1, paddingSize, cap->fp) != paddingSize) )
+	{
+		cap->isWriteFailed = TRUE;
+		return;
+	}
+	cap->offset += alignSize(size);
+}
+
+static void writeRecord(CAPTURE *cap, CAPTURERECORDTYPE type, DWORD size) {
+	CAPTURERECORD record;
+
+	record.type = type;
+	record.size = alignSize(size);
+	writeData(cap, &record, sizeof(record));
+}
+
+static LPDIRECT3DDEVICE2 *gameDevice(CAPTURE *cap) {
+	return *cap->pGameDevice;
+}
+
+static void writeDraw(CAPTURE *cap, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType, LPVOID vertices, DWORD vertexCount,
+					  LPWORD indices, DWORD indexCount, DWORD flags)
+{
+	CAPTUREDRAW draw;
+
+	draw.primitiveType = primitiveType;
+	draw.vertexType = vertexType;
+	draw.vertexCount = vertexCount;
+	draw.indexCount = indexCount;
+	draw.flags = flags;
+
+	writeRecord(cap, indices ? CRT_DRAWINDEXED : CRT_DRAW,
+				sizeof(draw) + vertexCount*CAPTURE_VERTEX_SIZE + alignSize(indexCount*sizeof(WORD)));
+	writeData(cap, &draw, sizeof(draw));
+	writeData(cap, vertices, vertexCount*CAPTURE_VERTEX_SIZE);
+	if( indices )
+		writeData(cap, indices, indexCount*sizeof(WORD));
+}
+
+// the device object is the capture state, as its interface is the first member
+static HRESULT __stdcall captureSetRenderState(struct IDirect3DDevice2 **This, D3DRENDERSTATETYPE state, DWORD value) {
+	CAPTURE *cap = (CAPTURE *)This;
+	CAPTURESTATE rs;
+
+	rs.state = state;
+	rs.value = value;
+	writeRecord(cap, CRT_RENDERSTATE, sizeof(rs));
+	writeData(cap, &rs, sizeof(rs));
+	return (*gameDevice(cap))->SetRenderState(gameDevice(cap), state, value);
+}
+
+static HRESULT __stdcall captureDrawPrimitive(struct IDirect3DDevice2 **This, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType,
+											  LPVOID vertices, DWORD vertexCount, DWORD flags)
+{
+	CAPTURE *cap = (CAPTURE *)This;
+
+	writeDraw(cap, primitiveType, vertexType, vertices, vertexCount, NULL, 0, flags);
+	return (*gameDevice(cap))->DrawPrimitive(gameDevice(cap), primitiveType, vertexType, vertices, vertexCount, flags);
+}
+
+static HRESULT __stdcall captureDrawIndexedPrimitive(struct IDirect3DDevice2 **This, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType,
+													 LPVOID vertices, DWORD vertexCount, LPWORD indices, DWORD indexCount, DWORD flags)
+{
+	CAPTURE *cap = (CAPTURE *)This;
+
+	writeDraw(cap, primitiveType, vertexType, vertices, vertexCount, indices, indexCount, flags);
+	return (*gameDevice(cap))->DrawIndexedPrimitive(gameDevice(cap), primitiveType, vertexType, vertices, vertexCount, indices, indexCount, flags);
+}
+
+BOOL startCapture(const char *fileName) {
+	CAPTUREHEADER header;
+
+	if( capture.fp != NULL )
+		stopCapture();
+
+	capture.fp = fopen(fileName, "wb");
+	if( capture.fp == NULL )
+		return FALSE;
+
+	capture.lpVtbl = &captureDeviceInterface;
+	capture.device = (LPDIRECT3DDEVICE2 *)&capture;
+	capture.offset = 0;
+	capture.frameCount = 0;
+	capture.isWriteFailed = FALSE;
+
+	header.magic = CAPTURE_MAGIC;
+	header.version = CAPTURE_VERSION;
+	writeData(&capture, &header, sizeof(header));
+	if( capture.isWriteFailed ) {
+		stopCapture();
+		return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL stopCapture(void) {
+	CAPTURETRAILER trailer;
+
+	if( capture.fp == NULL )
+		return TRUE;
+
+	trailer.magic = CAPTURE_INDEX_MAGIC;
+	trailer.indexOffset = capture.offset;
+
+	writeRecord(&capture, CRT_INDEX, sizeof(DWORD)*(capture.frameCount+1));
+	writeData(&capture, &capture.frameCount, sizeof(DWORD));
+	writeData(&capture, capture.frameOffsets, sizeof(DWORD)*capture.frameCount);
+	writeData(&capture, &trailer, sizeof(trailer));
+
+	// the buffered data are written by fclose, so it may fail too
+	BOOL result = ( fclose(capture.fp) == 0 && !capture.isWriteFailed );
+	free(capture.frameOffsets);
+	capture.fp = NULL;
+	capture.frameOffsets = NULL;
+	capture.frameCapacity = 0;
+	return result;
+}
+
+BOOL isCapturing(void) {
+	return ( capture.fp != NULL && !capture.isWriteFailed );
+}
+
+TR2CONTEXT *captureFrame(TR2CONTEXT *ctx) {
+	CAPTUREFRAME frame;
+
+	// after the write failure the frames are drawn directly, until the capture is stopped
+	if( !isCapturing() )
+		return ctx;
+
+	if( capture.frameCount == capture.frameCapacity ) {
+		DWORD capacity = capture.frameCapacity ? capture.frameCapacity*2 : 256;
+		DWORD *offsets = realloc(capture.frameOffsets, sizeof(DWORD)*capacity);
+		if( offsets == NULL ) {
+			stopCapture();
+			return ctx;
+		}
+		capture.frameOffsets = offsets;
+		capture.frameCapacity = capacity;
+	}
+
+	frame.frame = capture.frameCount;
+	frame.prevOffset = capture.frameCount ? capture.frameOffsets[capture.frameCount-1] : 0;
+	frame.screenWidth = *ctx->pScreenWidth;
+	frame.screenHeight = *ctx->pScreenHeight;
+	frame.currentTextureHandle = *ctx->pCurrentTextureHandle;
+	frame.currentAlphaState = *ctx->pCurrentAlphaState;
+	frame.alphaBlendAvailable = *ctx->pAlphaBlendAvailable;
+	frame.textureMargin = *ctx->pTextureMargin;
+	frame.rhwFactor = *ctx->pRhwFactor;
+	frame.farZ = *ctx->pFarZ;
+	frame.farZ_normal = *ctx->pFarZ_normal;
+	frame.depthZ_normal = *ctx->pDepthZ_normal;
+
+	capture.frameOffsets[capture.frameCount++] = capture.offset;
+	writeRecord(&capture, CRT_FRAME, sizeof(frame));
+	writeData(&capture, &frame, sizeof(frame));
+
+	capture.pGameDevice = ctx->pDxDevice;
+	capture.ctx = *ctx;
+	capture.ctx.pDxDevice = &capture.device;
+	return &capture.ctx;
+}
+
+static const CAPTURERECORD *getRecord(REPLAY *replay, DWORD offset) {
+	if( offset > replay->size || replay->size - offset < sizeof(CAPTURERECORD) )
+		return NULL;
+
+	const CAPTURERECORD *record = (const CAPTURERECORD *)(replay->data + offset);
+	if( record->size > replay->size - offset - sizeof(CAPTURERECORD) )
+		return NULL;
+
+	return record;
+}
+
+// takes frame index from the trailer, or scans all records if the capture was not stopped properly
+static BOOL loadFrameIndex(REPLAY *replay) {
+	const CAPTURERECORD *record;
+	DWORD capacity = 0;
+
+	if( replay->size >= sizeof(CAPTUREHEADER) + sizeof(CAPTURETRAILER) ) {
+		const CAPTURETRAILER *trailer = (const CAPTURETRAILER *)(replay->data + replay->size - sizeof(CAPTURETRAILER));
+		record = getRecord(replay, trailer->indexOffset);
+		if( trailer->magic == CAPTURE_INDEX_MAGIC && record != NULL && record->type == CRT_INDEX && record->size >= sizeof(DWORD) ) {
+			const DWORD *index = (const DWORD *)(record + 1);
+			if( index[0] <= (record->size / sizeof(DWORD)) - 1 ) {
+				replay->frameCount = index[0];
+				replay->frameOffsets = malloc(sizeof(DWORD)*(replay->frameCount+1));
+				if( replay->frameOffsets == NULL )
+					return FALSE;
+				memcpy(replay->frameOffsets, index+1, sizeof(DWORD)*replay->frameCount);
+				return TRUE;
+			}
+		}
+	}
+
+	replay->frameCount = 0;
+	for( DWORD offset = sizeof(CAPTUREHEADER); (record = getRecord(replay, offset)) != NULL; offset += sizeof(CAPTURERECORD) + record->size ) {
+		if( record->type != CRT_FRAME )
+			continue;
+
+		if( (DWORD)replay->frameCount == capacity ) {
+			capacity = capacity ? capacity*2 : 256;
+			DWORD *offsets = realloc(replay->frameOffsets, sizeof(DWORD)*capacity);
+			if( offsets == NULL )
+				return FALSE;
+			replay->frameOffsets = offsets;
+		}
+		replay->frameOffsets[replay->frameCount++] = offset;
+	}
+	return TRUE;
+}
+
+REPLAY *openReplay(const char *fileName) {
+	REPLAY *replay = calloc(1, sizeof(REPLAY));
+	if( replay == NULL )
+		return NULL;
+
+#ifdef _WIN32
+	replay->file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if( replay->file == INVALID_HANDLE_VALUE ) {
+		free(replay);
+		return NULL;
+	}
+	replay->size = GetFileSize(replay->file, NULL);
+	replay->mapping = CreateFileMappingA(replay->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if( replay->mapping != NULL )
+		replay->data = MapViewOfFile(replay->mapping, FILE_MAP_READ, 0, 0, 0);
+#else // _WIN32
+	struct stat st;
+	int fd = open(fileName, O_RDONLY);
+	if( fd < 0 ) {
+		free(replay);
+		return NULL;
+	}
+	if( fstat(fd, &st) == 0 && st.st_size > 0 ) {
+		void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if( data != MAP_FAILED ) {
+			replay->data = data;
+			replay->size = st.st_size;
+		}
+	}
+	close(fd);
+#endif // _WIN32
+
+	const CAPTUREHEADER *header = (const CAPTUREHEADER *)replay->data;
+	if( replay->data == NULL || replay->size < sizeof(CAPTUREHEADER)
+		|| header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION
+		|| !loadFrameIndex(replay) )
+	{
+		closeReplay(replay);
+		return NULL;
+	}
+	return replay;
+}
+
+void closeReplay(REPLAY *replay) {
+	if( replay == NULL )
+		return;
+
+#ifdef _WIN32
+	if( replay->data != NULL ) UnmapViewOfFile(replay->data);
+	if( replay->mapping != NULL ) CloseHandle(replay->mapping);
+	CloseHandle(replay->file);
+#else // _WIN32
+	if( replay->data != NULL ) munmap((void *)replay->data, replay->size);
+#endif // _WIN32
+	free(replay->frameOffsets);
+	free(replay);
+}
+
+int getReplayFrameCount(REPLAY *replay) {
+	return replay->frameCount;
+}
+
+const CAPTUREFRAME *getReplayFrame(REPLAY *replay, int frame) {
+	if( frame < 0 || frame >= replay->frameCount )
+		return NULL;
+
+	const CAPTURERECORD *record = getRecord(replay, replay->frameOffsets[frame]);
+	if( record == NULL || record->type != CRT_FRAME || record->size < sizeof(CAPTUREFRAME) )
+		return NULL;
+
+	return (const CAPTUREFRAME *)(record + 1);
+}
+
+int replayFrame(REPLAY *replay, int frame, LPDIRECT3DDEVICE2 *device) {
+	const CAPTURERECORD *record;
+	const CAPTUREFRAME *info = getReplayFrame(replay, frame);
+	int commandCount = 2;
+
+	if( info == NULL )
+		return -1;
+
+	// states applied by the game before the frame
+	(*device)->SetRenderState(device, D3DRENDERSTATE_TEXTUREHANDLE, info->currentTextureHandle);
+	(*device)->SetRenderState(device, info->alphaBlendAvailable ? D3DRENDERSTATE_ALPHABLENDENABLE : D3DRENDERSTATE_COLORKEYENABLE,
+							  info->currentAlphaState);
+
+	DWORD offset = replay->frameOffsets[frame];
+	record = getRecord(replay, offset);
+
+	for( offset += sizeof(CAPTURERECORD) + record->size; (record = getRecord(replay, offset)) != NULL; offset += sizeof(CAPTURERECORD) + record->size ) {
+		const BYTE *payload = (const BYTE *)(record + 1);
+
+		if( record->type == CRT_FRAME || record->type == CRT_INDEX )
+			break;
+
+		if( record->type == CRT_RENDERSTATE && record->size >= sizeof(CAPTURESTATE) ) {
+			const CAPTURESTATE *rs = (const CAPTURESTATE *)payload;
+			(*device)->SetRenderState(device, rs->state, rs->value);
+			++commandCount;
+		}
+		else if( (record->type == CRT_DRAW || record->type == CRT_DRAWINDEXED) && record->size >= sizeof(CAPTUREDRAW) ) {
+			const CAPTUREDRAW *draw = (const CAPTUREDRAW *)payload;
+			LPVOID vertices = (LPVOID)(payload + sizeof(CAPTUREDRAW));
+			DWORD vertexSize = draw->vertexCount*CAPTURE_VERTEX_SIZE;
+
+			if( vertexSize/CAPTURE_VERTEX_SIZE != draw->vertexCount
+				|| record->size - sizeof(CAPTUREDRAW) < vertexSize + draw->indexCount*sizeof(WORD) )
+			{
+				break; // damaged record
+			}
+
+			if( record->type == CRT_DRAW ) {
+				(*device)->DrawPrimitive(device, draw->primitiveType, draw->vertexType, vertices, draw->vertexCount, draw->flags);
+			} else {
+				LPWORD indices = (LPWORD)(payload + sizeof(CAPTUREDRAW) + vertexSize);
+				(*device)->DrawIndexedPrimitive(device, draw->primitiveType, draw->vertexType, vertices, draw->vertexCount,
+												indices, draw->indexCount, draw->flags);
+			}
+			++commandCount;
+		}
+	}
+	return commandCount;
+}
+
+/** @} */
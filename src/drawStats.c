@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Draw statistics
+ *
+ * This file implements counters of the device work and the timing
+ * of the wallpaper paths
+ */
+
+/**
+ * @defgroup DRAW_STATS Draw statistics
+ * @brief Draw statistics
+ *
+ * This module contains counters of the draw calls, vertices, render
+ * state changes and allocations, and the CPU time of the draw paths.
+ * Counting is just an interlocked addition, and the timing samples are
+ * stored in the ring buffers, so the statistics may be always on. Minimum,
+ * average and percentile values are calculated only when the statistics
+ * are queried. The statistics are shared by all wallpaper instances. The
+ * frame counters are merged to the totals, and the ring buffers are
+ * changed, under the statistics lock
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include "drawStats.h"
+#include "frameArena.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif // _WIN32
+
+/// Ring buffer of the path time samples (microseconds)
+typedef struct {
+	float samples[STATS_HISTORY_SIZE];	///< Time samples
+	DWORD count;	///< Number of samples stored
+	DWORD next;		///< Index of the next sample to replace
+} TIMEHISTORY;
+
+/// Counters of the current frame. They are changed by the interlocked additions, so the frame may be counted by several threads
+typedef struct {
+	volatile LONG drawPrimitiveCount;	///< Number of DrawPrimitive/DrawIndexedPrimitive calls
+	volatile LONG vertexCount;			///< Number of vertices submitted
+	volatile LONG renderStateCount;		///< Number of SetRenderState calls issued
+	volatile LONG renderStateElided;	///< Number of render state changes elided
+	volatile LONG allocatedBytes;		///< Number of bytes allocated
+} FRAMECOUNTERS;
+
+/// Statistics lock
+static CRITICAL_SECTION statsLock;
+/// Counters of the current frame
+static FRAMECOUNTERS frameCounters;
+/// Counters of the previous frames since reset
+static DRAWCOUNTERS totalCounters;
+/// Number of frames since reset
+static unsigned long long frameCount = 0;
+/// Time samples of the draw paths
+static TIMEHISTORY timeHistory[STATS_PATH_COUNT];
+
+static void addCounters(DRAWCOUNTERS *sum, const DRAWCOUNTERS *counters) {
+	sum->drawPrimitiveCount	+= counters->drawPrimitiveCount;
+	sum->vertexCount		+= counters->vertexCount;
+	sum->renderStateCount	+= counters->renderStateCount;
+	sum->renderStateElided	+= counters->renderStateElided;
+	sum->allocatedBytes		+= counters->allocatedBytes;
+}
+
+// reads the frame counter. If isTaken is TRUE, it is zeroed
+static DWORD readCounter(volatile LONG *counter, BOOL isTaken) {
+	return (DWORD)( isTaken ? InterlockedExchange(counter, 0) : InterlockedExchangeAdd(counter, 0) );
+}
+
+static void readFrameCounters(DRAWCOUNTERS *counters, BOOL isTaken) {
+	counters->drawPrimitiveCount	= readCounter(&frameCounters.drawPrimitiveCount, isTaken);
+	counters->vertexCount			= readCounter(&frameCounters.vertexCount, isTaken);
+	counters->renderStateCount		= readCounter(&frameCounters.renderStateCount, isTaken);
+	counters->renderStateElided		= readCounter(&frameCounters.renderStateElided, isTaken);
+	counters->allocatedBytes		= readCounter(&frameCounters.allocatedBytes, isTaken);
+}
+
+static int compareSamples(const void *a, const void *b) {
+	float fa = *(const float *)a;
+	float fb = *(const float *)b;
+	return ( fa > fb ) - ( fa < fb );
+}
+
+static void calcTiming(DRAWTIMING *timing, const TIMEHISTORY *history) {
+	float sorted[STATS_HISTORY_SIZE];
+	double sum = 0.0;
+
+	memset(timing, 0, sizeof(DRAWTIMING));
+	if( history->count == 0 )
+		return;
+
+	memcpy(sorted, history->samples, sizeof(float)*history->count);
+	qsort(sorted, history->count, sizeof(float), compareSamples);
+	for( DWORD i=0; i<history->count; ++i )
+		sum += sorted[i];
+
+	timing->sampleCount = history->count;
+	timing->minTime = sorted[0];
+	timing->avgTime = sum / history->count;
+	timing->p99Time = sorted[(history->count*99 + 99) / 100 - 1];
+	timing->lastTime = history->samples[(history->next + STATS_HISTORY_SIZE - 1) % STATS_HISTORY_SIZE];
+}
+
+void initDrawStats(void) {
+	InitializeCriticalSection(&statsLock);
+}
+
+void freeDrawStats(void) {
+	DeleteCriticalSection(&statsLock);
+}
+
+void countDrawCall(DWORD vertexCount) {
+	InterlockedIncrement(&frameCounters.drawPrimitiveCount);
+	InterlockedExchangeAdd(&frameCounters.vertexCount, vertexCount);
+}
+
+void countRenderStates(DWORD issued, DWORD elided) {
+	if( issued )
+		InterlockedExchangeAdd(&frameCounters.renderStateCount, issued);
+	if( elided )
+		InterlockedExchangeAdd(&frameCounters.renderStateElided, elided);
+}
+
+void countAllocation(size_t size) {
+	InterlockedExchangeAdd(&frameCounters.allocatedBytes, size);
+}
+
+void beginStatsFrame(void) {
+	DRAWCOUNTERS counters;
+
+	EnterCriticalSection(&statsLock);
+	readFrameCounters(&counters, TRUE);
+	addCounters(&totalCounters, &counters);
+	++frameCount;
+	LeaveCriticalSection(&statsLock);
+}
+
+long long getStatsTimer(void) {
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+#else // _WIN32
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif // _WIN32
+}
+
+float getStatsElapsed(long long startTime) {
+	long long ticks = getStatsTimer() - startTime;
+
+	// the frequency is not cached, as several threads may measure at once
+#ifdef _WIN32
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	double ticksPerMicrosecond = (double)frequency.QuadPart / 1e6;
+#else // _WIN32
+	double ticksPerMicrosecond = 1e3;
+#endif // _WIN32
+	return (double)ticks / ticksPerMicrosecond;
+}
+
+void addStatsTime(int path, long long startTime) {
+	if( path < 0 || path >= STATS_PATH_COUNT )
+		return;
+
+	float elapsed = getStatsElapsed(startTime);
+	TIMEHISTORY *history = &timeHistory[path];
+	EnterCriticalSection(&statsLock);
+	history->samples[history->next] = elapsed;
+	history->next = (history->next + 1) % STATS_HISTORY_SIZE;
+	if( history->count < STATS_HISTORY_SIZE )
+		++history->count;
+	LeaveCriticalSection(&statsLock);
+}
+
+void getDrawStats(DRAWSTATS *stats) {
+	EnterCriticalSection(&statsLock);
+	readFrameCounters(&stats->frame, FALSE);
+	stats->frameCount = frameCount;
+	stats->total = totalCounters;
+	addCounters(&stats->total, &stats->frame);
+	for( int i=0; i<STATS_PATH_COUNT; ++i )
+		calcTiming(&stats->timing[i], &timeHistory[i]);
+	LeaveCriticalSection(&statsLock);
+
+	size_t highWater, capacity;
+	getFrameArenaUsage(&highWater, &capacity);
+	stats->arenaHighWater = highWater;
+	stats->arenaCapacity = capacity;
+}
+
+void resetDrawStats(void) {
+	DRAWCOUNTERS counters;
+
+	EnterCriticalSection(&statsLock);
+	readFrameCounters(&counters, TRUE);
+	memset(&totalCounters, 0, sizeof(totalCounters));
+	memset(timeHistory, 0, sizeof(timeHistory));
+	frameCount = 0;
+	LeaveCriticalSection(&statsLock);
+}
+
+/** @} */
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Frame arena
+ *
+ * This file implements arena allocator for the memory used within one frame
+ */
+
+/**
+ * @defgroup FRAME_ARENA Frame arena
+ * @brief Frame arena allocator
+ *
+ * This module contains bump allocator for the vertex, index and staging
+ * buffers used within one frame. The arena is reset at the frame start.
+ * If a frame needs more memory, the arena chains new blocks of doubled
+ * size, and at the next reset the chain is replaced by one block of the
+ * total size. So the heap is used only while the frame memory grows,
+ * and the steady state frames do not allocate at all. Each draw context
+ * has its own arena, only the usage totals are shared
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include "drawStats.h"
+#include "frameArena.h"
+#include "sharedLock.h"
+
+/// Arena memory block
+struct ARENABLOCK {
+	struct ARENABLOCK *prev;	///< Previous block of the chain
+	size_t size;	///< Size of the block data (bytes)
+	size_t used;	///< Number of bytes used
+	BYTE *data;		///< Block data (ARENA_ALIGNMENT bytes aligned)
+};
+
+/// Maximum number of bytes used by one frame of any arena
+static size_t totalHighWater = 0;
+/// Number of bytes reserved by all arenas
+static size_t totalReserved = 0;
+
+static size_t alignSize(size_t size) {
+	return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static void addReserved(FRAMEARENA *arena, size_t size) {
+	arena->reserved += size;
+	lockSharedState();
+	totalReserved += size;
+	unlockSharedState();
+}
+
+static void subReserved(FRAMEARENA *arena, size_t size) {
+	arena->reserved -= size;
+	lockSharedState();
+	totalReserved -= size;
+	unlockSharedState();
+}
+
+static ARENABLOCK *createBlock(FRAMEARENA *arena, size_t size, ARENABLOCK *prev) {
+	size_t headerSize = alignSize(sizeof(ARENABLOCK));
+	BYTE *memory = malloc(headerSize + size + ARENA_ALIGNMENT);
+	if( memory == NULL )
+		return NULL;
+
+	countAllocation(headerSize + size + ARENA_ALIGNMENT);
+	ARENABLOCK *block = (ARENABLOCK *)memory;
+	block->prev = prev;
+	block->size = size;
+	block->used = 0;
+	block->data = (BYTE *)alignSize((size_t)memory + headerSize);
+	addReserved(arena, size);
+	return block;
+}
+
+static void freeBlocks(FRAMEARENA *arena) {
+	while( arena->currentBlock != NULL ) {
+		ARENABLOCK *prev = arena->currentBlock->prev;
+		subReserved(arena, arena->currentBlock->size);
+		free(arena->currentBlock);
+		arena->currentBlock = prev;
+	}
+}
+
+void *arenaAlloc(FRAMEARENA *arena, size_t size) {
+	ARENABLOCK *current = arena->currentBlock;
+	size = alignSize(size);
+
+	if( current == NULL || current->size - current->used < size ) {
+		size_t blockSize = current ? current->size*2 : ARENA_INITIAL_SIZE;
+		while( blockSize < size )
+			blockSize *= 2;
+
+		current = createBlock(arena, blockSize, current);
+		if( current == NULL )
+			return NULL;
+		arena->currentBlock = current;
+	}
+
+	void *result = current->data + current->used;
+	current->used += size;
+	arena->frameUsed += size;
+	// the shared total is touched only while the arena grows
+	if( arena->highWater < arena->frameUsed ) {
+		arena->highWater = arena->frameUsed;
+		lockSharedState();
+		if( totalHighWater < arena->highWater )
+			totalHighWater = arena->highWater;
+		unlockSharedState();
+	}
+	return result;
+}
+
+void resetFrameArena(FRAMEARENA *arena) {
+	arena->frameUsed = 0;
+	if( arena->currentBlock == NULL )
+		return;
+
+	// the frame did not fit into one block: consolidate the chain
+	if( arena->currentBlock->prev != NULL ) {
+		size_t size = arena->reserved;
+		freeBlocks(arena);
+		arena->currentBlock = createBlock(arena, size, NULL);
+		return;
+	}
+	arena->currentBlock->used = 0;
+}
+
+void releaseFrameArena(FRAMEARENA *arena) {
+	freeBlocks(arena);
+	arena->frameUsed = 0;
+}
+
+void getFrameArenaUsage(size_t *highWaterSize, size_t *capacity) {
+	lockSharedState();
+	if( highWaterSize != NULL )
+		*highWaterSize = totalHighWater;
+	if( capacity != NULL )
+		*capacity = totalReserved;
+	unlockSharedState();
+}
+
+/** @} */
@@ -29,24 +29,339 @@
  * @brief General graphic routines
  *
  * This module contains very general functions for rendering 3D primitives.
+ * The draw batch, the frame arena, the cached index buffers and UV
+ * rectangles and the frame constants belong to the draw context, so the
+ * contexts may be drawn by different threads. The device submissions and
+ * the render state shadow table are shared, so they are done under the
+ * shared lock
  * @{
 
  */
 #include <stdlib.h>
+#include "drawStats.h"
+#include "frameArena.h"
 #include "generalDraw.h"
+#include "renderState.h"
+#include "sharedLock.h"
+#include "vertexConvert.h"
+
+/// Maximum number of vertices sent by one DrawPrimitive call (DX5 D3DMAXNUMVERTICES is 1024, rounded down to whole quads)
+#define BATCH_MAX_VERTICES	(1020)
+
+/// Layout of one axis of the indexed grid
+typedef struct {
+	int count;	///< Number of source grid vertices along the axis (cache key)
+	int detail;	///< Number of quads per texture tile along the axis, 0 if untextured (cache key)
+	int expandedCount;	///< Number of vertices along the axis after duplication of the texture tile edges
+	int *source;	///< Source grid vertex of each expanded vertex
+	int *tilePos;	///< Subtexture step (0..detail) of each expanded vertex
+	int *quadLo;	///< Expanded vertex of the quad near side
+	int *quadHi;	///< Expanded vertex of the quad far side
+} GRIDAXIS;
+
+/// Cached index buffer of the indexed grid
+typedef struct {
+	GRIDAXIS axisX;	///< Layout of the grid columns
+	GRIDAXIS axisY;	///< Layout of the grid rows
+	WORD *indices;	///< Triangle list indices
+	int indexCount;	///< Number of indices
+} GRIDINDEX;
+
+/// Maximum texture detail level whose tile UV coordinates are cached
+#define UV_CACHE_MAX_DETAIL	(16)
+/// Number of cached texture UV rectangles
+#define UV_CACHE_SIZE	(8)
+
+/// Precomputed UV coordinates of texture tile
+typedef struct {
+	DWORD generation;	///< Frame constants generation of the cached values (0 means unused)
+	TEXTURE txr;	///< Texture rectangle (cache key)
+	int detail;		///< Number of subtextures per tile along each axis (cache key)
+	float u[UV_CACHE_MAX_DETAIL+1];	///< U coordinates of subtexture edges (margins applied to the outer edges)
+	float v[UV_CACHE_MAX_DETAIL+1];	///< V coordinates of subtexture edges (margins applied to the outer edges)
+} UVRECT;
+
+/// Draw context
+struct DRAWCONTEXT {
+	VERTEX_ALIGNED D3DTLVERTEX batchVertices[BATCH_MAX_VERTICES];	///< Draw batch staging buffer (triangle list, 6 vertices per quad)
+	int batchVertexCount;		///< Number of vertices stored in the staging buffer
+	DWORD batchTextureHandle;	///< Texture handle of the vertices stored in the staging buffer
+	BYTE batchAlphaState;		///< Alpha state of the vertices stored in the staging buffer
+	GRIDINDEX coloredGridIndex;		///< Index buffer of the untextured grid
+	GRIDINDEX texturedGridIndex;	///< Index buffer of the textured grid
+	DRAWCONSTANTS constants;	///< Frame constants snapshot
+	UVRECT uvCache[UV_CACHE_SIZE];	///< Texture UV rectangles cache
+	int uvCacheNext;			///< Next UV rectangle to replace
+	float coloredZ;				///< Z coordinate of the last colored quad
+	DWORD coloredGeneration;	///< Generation of the last colored quad constants (0 means unused)
+	float coloredRhw;			///< rhw of the last colored quad
+	float coloredZNormal;		///< Normalized Z of the last colored quad
+	FRAMEARENA arena;			///< Frame arena of the grids and the staging buffers
+	void *memory;				///< Allocated memory block
+};
 
 static void setTextureHandle(TR2CONTEXT *ctx, DWORD handle) {
-	if( handle != *ctx->pCurrentTextureHandle ) {
-		*ctx->pCurrentTextureHandle = handle;
-		(**ctx->pDxDevice)->SetRenderState(*ctx->pDxDevice, D3DRENDERSTATE_TEXTUREHANDLE, handle);
-	}
+	setRenderState(D3DRENDERSTATE_TEXTUREHANDLE, handle);
 }
 
 static void setAlphaState(TR2CONTEXT *ctx, BYTE state) {
-	if ( state != *ctx->pCurrentAlphaState ) {
-		*ctx->pCurrentAlphaState = state;
-		(**ctx->pDxDevice)->SetRenderState(*ctx->pDxDevice, *ctx->pAlphaBlendAvailable ? D3DRENDERSTATE_ALPHABLENDENABLE : D3DRENDERSTATE_COLORKEYENABLE, state);
+	setRenderState(*ctx->pAlphaBlendAvailable ? D3DRENDERSTATE_ALPHABLENDENABLE : D3DRENDERSTATE_COLORKEYENABLE, state);
+}
+
+// reserves 6 triangle list vertices in the staging buffer, flushing it if the state key changes or it is full
+static D3DTLVERTEX *allocBatchQuad(DRAWCONTEXT *dc, TR2CONTEXT *ctx, DWORD textureHandle, BYTE alphaState) {
+	if( dc->batchVertexCount > 0 && (textureHandle != dc->batchTextureHandle || alphaState != dc->batchAlphaState) )
+		flushDrawBatch(dc, ctx);
+
+	if( dc->batchVertexCount + 6 > BATCH_MAX_VERTICES )
+		flushDrawBatch(dc, ctx);
+
+	dc->batchTextureHandle = textureHandle;
+	dc->batchAlphaState = alphaState;
+
+	D3DTLVERTEX *vtx = &dc->batchVertices[dc->batchVertexCount];
+	dc->batchVertexCount += 6;
+	return vtx;
+}
+
+// quad corners are stored in slots 0,1,2,5. Slots 3,4 duplicate the shared edge: triangles are (0,1,2) and (2,1,3)
+static void completeBatchQuad(D3DTLVERTEX *vtx) {
+	vtx[3] = vtx[2];
+	vtx[4] = vtx[1];
+}
+
+void flushDrawBatch(DRAWCONTEXT *dc, TR2CONTEXT *ctx) {
+	if( dc->batchVertexCount == 0 )
+		return;
+
+	// the render states are shared, so they are applied together with the draw
+	lockSharedState();
+	setTextureHandle(ctx, dc->batchTextureHandle);
+	setAlphaState(ctx, dc->batchAlphaState);
+	flushRenderStates(ctx);
+	(**ctx->pDxDevice)->DrawPrimitive(*ctx->pDxDevice, D3DPT_TRIANGLELIST, D3DVT_TLVERTEX, dc->batchVertices, dc->batchVertexCount, D3DDP_DONOTUPDATEEXTENTS|D3DDP_DONOTCLIP);
+	countDrawCall(dc->batchVertexCount);
+	unlockSharedState();
+	dc->batchVertexCount = 0;
+}
+
+// builds axis layout. Inner texture tile edges get two vertices: the end of one tile and the start of the next one
+static int buildGridAxis(GRIDAXIS *axis, int count, int detail) {
+	int expandedCount = 0;
+
+	free(axis->source);
+	axis->source = malloc(sizeof(int)*count*6);
+	countAllocation(sizeof(int)*count*6);
+	axis->count = 0;
+	if( axis->source == NULL )
+		return 0;
+
+	axis->tilePos = axis->source  + count*2;
+	axis->quadLo  = axis->tilePos + count*2;
+	axis->quadHi  = axis->quadLo  + count;
+
+	for( int i=0; i<count; ++i ) {
+		int k = detail ? i%detail : 0;
+		int isTileEdge = ( detail && k == 0 && i > 0 );
+
+		if( isTileEdge && i < count-1 ) {
+			axis->source[expandedCount] = i;
+			axis->tilePos[expandedCount] = detail;
+			axis->quadHi[i-1] = expandedCount++;
+			axis->source[expandedCount] = i;
+			axis->tilePos[expandedCount] = 0;
+			axis->quadLo[i] = expandedCount++;
+		} else {
+			axis->source[expandedCount] = i;
+			axis->tilePos[expandedCount] = isTileEdge ? detail : k;
+			if( i > 0 ) axis->quadHi[i-1] = expandedCount;
+			if( i < count-1 ) axis->quadLo[i] = expandedCount;
+			++expandedCount;
+		}
+	}
+	axis->count = count;
+	axis->detail = detail;
+	axis->expandedCount = expandedCount;
+	return 1;
+}
+
+// rebuilds index buffer only if the grid dimensions are changed. Returns NULL if the grid is too large.
+// Too large grid keeps its axes, so the check is not repeated every frame
+static GRIDINDEX *getGridIndex(GRIDINDEX *grid, int countX, int countY, int detail) {
+	if( grid->axisX.count != countX || grid->axisX.detail != detail
+		|| grid->axisY.count != countY || grid->axisY.detail != detail )
+	{
+		free(grid->indices);
+		grid->indices = NULL;
+
+		if( !buildGridAxis(&grid->axisX, countX, detail) || !buildGridAxis(&grid->axisY, countY, detail) ) {
+			grid->axisX.count = 0;
+			return NULL;
+		}
+
+		int expandedY = grid->axisY.expandedCount;
+		if( grid->axisX.expandedCount*expandedY > BATCH_MAX_VERTICES )
+			return NULL;
+
+		grid->indexCount = 6*(countX-1)*(countY-1);
+		grid->indices = malloc(sizeof(WORD)*grid->indexCount);
+		countAllocation(sizeof(WORD)*grid->indexCount);
+		if( grid->indices == NULL ) {
+			grid->axisX.count = 0;
+			return NULL;
+		}
+
+		WORD *idx = grid->indices;
+		for( int i=0; i<countX-1; ++i ) {
+			for( int j=0; j<countY-1; ++j ) {
+				WORD v0 = grid->axisX.quadLo[i]*expandedY + grid->axisY.quadLo[j];
+				WORD v1 = grid->axisX.quadHi[i]*expandedY + grid->axisY.quadLo[j];
+				WORD v2 = grid->axisX.quadLo[i]*expandedY + grid->axisY.quadHi[j];
+				WORD v3 = grid->axisX.quadHi[i]*expandedY + grid->axisY.quadHi[j];
+				// same triangles as the draw batch quad: (0,1,2) and (2,1,3)
+				*idx++ = v0; *idx++ = v1; *idx++ = v2;
+				*idx++ = v2; *idx++ = v1; *idx++ = v3;
+			}
+		}
 	}
+	return grid->indices ? grid : NULL;
+}
+
+static void drawIndexedGrid(TR2CONTEXT *ctx, D3DTLVERTEX *vertices, int vertexCount, WORD *indices, int indexCount, DWORD textureHandle) {
+	lockSharedState();
+	setTextureHandle(ctx, textureHandle);
+	setAlphaState(ctx, FALSE);
+	flushRenderStates(ctx);
+	(**ctx->pDxDevice)->DrawIndexedPrimitive(*ctx->pDxDevice, D3DPT_TRIANGLELIST, D3DVT_TLVERTEX,
+											 vertices, vertexCount, indices, indexCount, D3DDP_DONOTUPDATEEXTENTS|D3DDP_DONOTCLIP);
+	countDrawCall(vertexCount);
+	unlockSharedState();
+}
+
+// gets texture coordinate of the subtexture edge of the texture tile. Only the outer edges of the tile have margins,
+// the inner edges are shared by the neighbour subtextures of the same tile
+static float getTileEdgeUV(const DRAWCONSTANTS *constants, int pos, int size, int detail, int edge) {
+	double uv = (double)(pos + edge*(size/detail)) / 256.0;
+
+	if( edge == 0 )
+		uv += constants->halfPixel;
+	if( edge == detail )
+		uv -= constants->halfPixel;
+	return uv;
+}
+
+// returns cached UV rectangle of the texture tile (detail must not exceed UV_CACHE_MAX_DETAIL)
+static UVRECT *getUVRect(DRAWCONTEXT *dc, TEXTURE *txr, int detail) {
+	const DRAWCONSTANTS *constants = &dc->constants;
+	UVRECT *rect;
+
+	for( int i=0; i<UV_CACHE_SIZE; ++i ) {
+		rect = &dc->uvCache[i];
+		if( rect->generation == constants->generation && rect->detail == detail
+			&& rect->txr.handle == txr->handle && rect->txr.x == txr->x && rect->txr.y == txr->y
+			&& rect->txr.width == txr->width && rect->txr.height == txr->height )
+		{
+			return rect;
+		}
+	}
+
+	rect = &dc->uvCache[dc->uvCacheNext];
+	dc->uvCacheNext = (dc->uvCacheNext + 1) % UV_CACHE_SIZE;
+
+	for( int i=0; i<=detail; ++i ) {
+		rect->u[i] = getTileEdgeUV(constants, txr->x, txr->width,  detail, i);
+		rect->v[i] = getTileEdgeUV(constants, txr->y, txr->height, detail, i);
+	}
+	rect->txr = *txr;
+	rect->detail = detail;
+	rect->generation = constants->generation;
+	return rect;
+}
+
+DRAWCONTEXT *createDrawContext(void) {
+	size_t size = sizeof(DRAWCONTEXT) + VERTEX_ALIGNMENT;
+	void *memory = calloc(1, size);
+
+	if( memory == NULL )
+		return NULL;
+	countAllocation(size);
+
+	// the staging buffer must be aligned for the bulk vertex conversion
+	DRAWCONTEXT *dc = (DRAWCONTEXT *)(((size_t)memory + VERTEX_ALIGNMENT - 1) & ~(size_t)(VERTEX_ALIGNMENT - 1));
+	dc->memory = memory;
+	return dc;
+}
+
+static void freeGridIndex(GRIDINDEX *grid) {
+	free(grid->axisX.source);
+	free(grid->axisY.source);
+	free(grid->indices);
+}
+
+void freeDrawContext(DRAWCONTEXT *dc) {
+	if( dc == NULL )
+		return;
+
+	freeGridIndex(&dc->coloredGridIndex);
+	freeGridIndex(&dc->texturedGridIndex);
+	releaseFrameArena(&dc->arena);
+	free(dc->memory);
+}
+
+void beginDrawFrame(DRAWCONTEXT *dc, TR2CONTEXT *ctx) {
+	lockSharedState();
+	beginStatsFrame();
+	importHostRenderStates(ctx);
+	unlockSharedState();
+	resetFrameArena(&dc->arena);
+	updateDrawConstants(dc, ctx);
+}
+
+void updateDrawConstants(DRAWCONTEXT *dc, TR2CONTEXT *ctx) {
+	DRAWCONSTANTS *constants = &dc->constants;
+
+	if( constants->generation != 0
+		&& constants->screenWidth == *ctx->pScreenWidth
+		&& constants->screenHeight == *ctx->pScreenHeight
+		&& constants->textureMargin == *ctx->pTextureMargin
+		&& constants->rhwFactor == *ctx->pRhwFactor
+		&& constants->farZ == *ctx->pFarZ
+		&& constants->farZ_normal == *ctx->pFarZ_normal
+		&& constants->depthZ_normal == *ctx->pDepthZ_normal )
+	{
+		return;
+	}
+
+	constants->screenWidth		= *ctx->pScreenWidth;
+	constants->screenHeight		= *ctx->pScreenHeight;
+	constants->textureMargin	= *ctx->pTextureMargin;
+	constants->rhwFactor		= *ctx->pRhwFactor;
+	constants->farZ				= *ctx->pFarZ;
+	constants->farZ_normal		= *ctx->pFarZ_normal;
+	constants->depthZ_normal	= *ctx->pDepthZ_normal;
+	constants->farRhw			= constants->rhwFactor / constants->farZ;
+	constants->halfPixel		= ((double)constants->textureMargin) / 65536.0;
+
+	if( ++constants->generation == 0 )
+		++constants->generation; // zero generation means invalid cache entry
+}
+
+void endDrawFrame(DRAWCONTEXT *dc, TR2CONTEXT *ctx) {
+	flushDrawBatch(dc, ctx);
+}
+
+const DRAWCONSTANTS *getDrawConstants(DRAWCONTEXT *dc) {
+	return &dc->constants;
+}
+
+BOOL isSameDrawConstants(const DRAWCONSTANTS *a, const DRAWCONSTANTS *b) {
+	return ( a->screenWidth == b->screenWidth
+		&& a->screenHeight == b->screenHeight
+		&& a->textureMargin == b->textureMargin
+		&& a->rhwFactor == b->rhwFactor
+		&& a->farZ == b->farZ
+		&& a->farZ_normal == b->farZ_normal
+		&& a->depthZ_normal == b->depthZ_normal );
 }
 
 D3DCOLOR grayToRGBA(int gray, int inverted) {
@@ -58,12 +373,38 @@ D3DCOLOR grayToRGBA(int gray, int inverted) {
 	return RGBA_MAKE(ch, ch, ch, 0xFFu);
 }
 
-void renderColoredQuad(TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D *vtx2, VERTEX2D *vtx3, float z) {
-	D3DTLVERTEX vtx[4];
-	memset(vtx, 0, sizeof(vtx));
+BOOL allocGrid(DRAWCONTEXT *dc, GRID2D *grid, int countX, int countY) {
+	int stride = (countY + GRID_STRIDE_ALIGN - 1) / GRID_STRIDE_ALIGN * GRID_STRIDE_ALIGN;
+	size_t arraySize = sizeof(float)*countX*stride;
+
+	grid->countX = countX;
+	grid->countY = countY;
+	grid->stride = stride;
+	grid->x = arenaAlloc(&dc->arena, arraySize);
+	grid->y = arenaAlloc(&dc->arena, arraySize);
+	grid->color = arenaAlloc(&dc->arena, arraySize);
+	return ( grid->x != NULL && grid->y != NULL && grid->color != NULL );
+}
+
+void getGridVertex(GRID2D *grid, int i, int j, VERTEX2D *vtx) {
+	int k = i*grid->stride + j;
+	vtx->x = grid->x[k];
+	vtx->y = grid->y[k];
+	vtx->color = grid->color[k];
+}
+
+void renderColoredQuad(DRAWCONTEXT *dc, TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D *vtx2, VERTEX2D *vtx3, float z) {
+	D3DTLVERTEX *vtx = allocBatchQuad(dc, ctx, 0, FALSE);
+	memset(vtx, 0, sizeof(D3DTLVERTEX)*6);
 
-	float rhw = *ctx->pRhwFactor / z;
-	float zNormal = *ctx->pFarZ_normal - *ctx->pDepthZ_normal * rhw;
+	if( dc->coloredGeneration != dc->constants.generation || dc->coloredZ != z ) {
+		dc->coloredGeneration = dc->constants.generation;
+		dc->coloredZ = z;
+		dc->coloredRhw = dc->constants.rhwFactor / z;
+		dc->coloredZNormal = dc->constants.farZ_normal - dc->constants.depthZ_normal * dc->coloredRhw;
+	}
+	float rhw = dc->coloredRhw;
+	float zNormal = dc->coloredZNormal;
 
 	vtx[0].sx = vtx0->x;
 	vtx[0].sy = vtx0->y;
@@ -83,27 +424,25 @@ void renderColoredQuad(TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D
 	vtx[2].rhw = rhw;
 	vtx[2].color = vtx2->color;
 
-	vtx[3].sx = vtx3->x;
-	vtx[3].sy = vtx3->y;
-	vtx[3].sz = zNormal;
-	vtx[3].rhw = rhw;
-	vtx[3].color = vtx3->color;
+	vtx[5].sx = vtx3->x;
+	vtx[5].sy = vtx3->y;
+	vtx[5].sz = zNormal;
+	vtx[5].rhw = rhw;
+	vtx[5].color = vtx3->color;
 
-	setTextureHandle(ctx, 0);
-	setAlphaState(ctx, FALSE);
-	(**ctx->pDxDevice)->DrawPrimitive(*ctx->pDxDevice, D3DPT_TRIANGLESTRIP, D3DVT_TLVERTEX, &vtx, 4, D3DDP_DONOTUPDATEEXTENTS|D3DDP_DONOTCLIP);
+	completeBatchQuad(vtx);
 }
 
-void renderTexturedFarQuad(TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D *vtx2, VERTEX2D *vtx3, TEXTURE *txr) {
-	D3DTLVERTEX vtx[4];
-	double halfPixel = ((double)*ctx->pTextureMargin) / 65536.0;
+void renderTexturedFarQuad(DRAWCONTEXT *dc, TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERTEX2D *vtx2, VERTEX2D *vtx3, TEXTURE *txr) {
+	D3DTLVERTEX *vtx = allocBatchQuad(dc, ctx, txr->handle, FALSE);
+	UVRECT *uv = getUVRect(dc, txr, 1);
 
-	float tu_left	= ((double)(txr->x)					/ 256.0) + halfPixel;
-	float tu_right	= ((double)(txr->x + txr->width)	/ 256.0) - halfPixel;
-	float tv_top	= ((double)(txr->y)					/ 256.0) + halfPixel;
-	float tv_bottom	= ((double)(txr->y + txr->height)	/ 256.0) - halfPixel;
+	float tu_left	= uv->u[0];
+	float tu_right	= uv->u[1];
+	float tv_top	= uv->v[0];
+	float tv_bottom	= uv->v[1];
 
-	float rhw = *ctx->pRhwFactor / *ctx->pFarZ;
+	float rhw = dc->constants.farRhw;
 
 	vtx[0].sx = vtx0->x;
 	vtx[0].sy = vtx0->y;
@@ -132,18 +471,206 @@ void renderTexturedFarQuad(TR2CONTEXT *ctx, VERTEX2D *vtx0, VERTEX2D *vtx1, VERT
 	vtx[2].tu = tu_left;
 	vtx[2].tv = tv_bottom;
 
-	vtx[3].sx = vtx3->x;
-	vtx[3].sy = vtx3->y;
-	vtx[3].sz = 0.995;
-	vtx[3].rhw = rhw;
-	vtx[3].color = vtx3->color;
-	vtx[3].specular = 0;
-	vtx[3].tu = tu_right;
-	vtx[3].tv = tv_bottom;
+	vtx[5].sx = vtx3->x;
+	vtx[5].sy = vtx3->y;
+	vtx[5].sz = 0.995;
+	vtx[5].rhw = rhw;
+	vtx[5].color = vtx3->color;
+	vtx[5].specular = 0;
+	vtx[5].tu = tu_right;
+	vtx[5].tv = tv_bottom;
 
-	setTextureHandle(ctx, txr->handle);
-	setAlphaState(ctx, FALSE);
-	(**ctx->pDxDevice)->DrawPrimitive(*ctx->pDxDevice, D3DPT_TRIANGLESTRIP, D3DVT_TLVERTEX, &vtx, 4, D3DDP_DONOTUPDATEEXTENTS|D3DDP_DONOTCLIP);
+	completeBatchQuad(vtx);
+}
+
+void renderColoredGrid(DRAWCONTEXT *dc, TR2CONTEXT *ctx, GRID2D *grid, float z) {
+	int countX = grid->countX;
+	int countY = grid->countY;
+	VERTEX2D vtx[4];
+
+	if( countX < 2 || countY < 2 )
+		return;
+
+	GRIDINDEX *index = getGridIndex(&dc->coloredGridIndex, countX, countY, 0);
+
+	if( index == NULL ) {
+		for( int i=0; i<countX-1; ++i ) {
+			for( int j=0; j<countY-1; ++j ) {
+				getGridVertex(grid, i+0, j+0, &vtx[0]);
+				getGridVertex(grid, i+1, j+0, &vtx[1]);
+				getGridVertex(grid, i+0, j+1, &vtx[2]);
+				getGridVertex(grid, i+1, j+1, &vtx[3]);
+				renderColoredQuad(dc, ctx, &vtx[0], &vtx[1], &vtx[2], &vtx[3], z);
+			}
+		}
+		return;
+	}
+
+	D3DTLVERTEX pattern;
+	memset(&pattern, 0, sizeof(pattern));
+	pattern.rhw = dc->constants.rhwFactor / z;
+	pattern.sz = dc->constants.farZ_normal - dc->constants.depthZ_normal * pattern.rhw;
+
+	// the staging buffer is reused for the grid vertices
+	flushDrawBatch(dc, ctx);
+
+	for( int i=0; i<countX; ++i ) {
+		int k = i*grid->stride;
+		convertVertices(&dc->batchVertices[i*countY], &grid->x[k], &grid->y[k], &grid->color[k], NULL, &pattern, 0, countY);
+	}
+	drawIndexedGrid(ctx, dc->batchVertices, countX*countY, index->indices, index->indexCount, 0);
+}
+
+// gets number of the indexed grid vertices along the axis. Inner texture tile edges have two vertices
+static int getExpandedCount(int count, int detail) {
+	return count + (count-2)/detail;
+}
+
+BOOL isTexturedGridIndexed(int countX, int countY, int detail) {
+	if( countX < 2 || countY < 2 || detail < 2 || detail > UV_CACHE_MAX_DETAIL )
+		return FALSE;
+	return ( getExpandedCount(countX, detail)*getExpandedCount(countY, detail) <= BATCH_MAX_VERTICES );
+}
+
+// returns index buffer of the textured grid, or NULL if the grid must be drawn quad by quad
+static GRIDINDEX *getTexturedGridIndex(DRAWCONTEXT *dc, GRID2D *grid, int detail) {
+	if( detail > UV_CACHE_MAX_DETAIL )
+		return NULL;
+	return getGridIndex(&dc->texturedGridIndex, grid->countX, grid->countY, detail);
+}
+
+// converts textured grid to the indexed vertices of the index buffer layout. The subtextures
+// of one tile share their edge vertices, so they have no margins at these edges
+static BOOL convertTexturedGrid(DRAWCONTEXT *dc, D3DTLVERTEX *out, GRIDINDEX *index, GRID2D *grid, TEXTURE *txr, int detail) {
+	GRIDAXIS *axisX = &index->axisX;
+	GRIDAXIS *axisY = &index->axisY;
+	UVRECT *uv = getUVRect(dc, txr, detail);
+	D3DTLVERTEX *columnPatterns = arenaAlloc(&dc->arena, sizeof(D3DTLVERTEX)*(detail+1)*axisY->expandedCount);
+
+	if( columnPatterns == NULL )
+		return FALSE;
+
+	// all columns with the same texture tile step share the pattern column
+	for( int k=0; k<=detail; ++k ) {
+		for( int j=0; j<axisY->expandedCount; ++j ) {
+			D3DTLVERTEX *vtx = &columnPatterns[k*axisY->expandedCount+j];
+			memset(vtx, 0, sizeof(D3DTLVERTEX));
+			vtx->sz = 0.995;
+			vtx->rhw = dc->constants.farRhw;
+			vtx->tu = uv->u[k];
+			vtx->tv = uv->v[axisY->tilePos[j]];
+		}
+	}
+
+	for( int i=0; i<axisX->expandedCount; ++i ) {
+		int k = axisX->source[i]*grid->stride;
+		convertVertices(&out[i*axisY->expandedCount], &grid->x[k], &grid->y[k], &grid->color[k], axisY->source,
+						&columnPatterns[axisX->tilePos[i]*axisY->expandedCount], 1, axisY->expandedCount);
+	}
+	return TRUE;
+}
+
+static void setGridFarVertex(D3DTLVERTEX *vtx, GRID2D *grid, int k, float rhw, float tu, float tv) {
+	vtx->sx = grid->x[k];
+	vtx->sy = grid->y[k];
+	vtx->sz = 0.995;
+	vtx->rhw = rhw;
+	vtx->color = grid->color[k];
+	vtx->specular = 0;
+	vtx->tu = tu;
+	vtx->tv = tv;
+}
+
+// sends the grid quad of column i and row j to the draw batch with the texture coordinates
+static void emitTexturedGridQuad(DRAWCONTEXT *dc, TR2CONTEXT *ctx, GRID2D *grid, int i, int j, DWORD handle,
+								 float tu0, float tu1, float tv0, float tv1)
+{
+	D3DTLVERTEX *vtx = allocBatchQuad(dc, ctx, handle, FALSE);
+	float rhw = dc->constants.farRhw;
+	int k = i*grid->stride + j;
+
+	setGridFarVertex(&vtx[0], grid, k, rhw, tu0, tv0);
+	setGridFarVertex(&vtx[1], grid, k+grid->stride, rhw, tu1, tv0);
+	setGridFarVertex(&vtx[2], grid, k+1, rhw, tu0, tv1);
+	setGridFarVertex(&vtx[5], grid, k+grid->stride+1, rhw, tu1, tv1);
+	completeBatchQuad(vtx);
+}
+
+void renderTexturedFarGrid(DRAWCONTEXT *dc, TR2CONTEXT *ctx, GRID2D *grid, TEXTURE *txr, int detail) {
+	int countX = grid->countX;
+	int countY = grid->countY;
+
+	if( countX < 2 || countY < 2 || detail < 1 )
+		return;
+
+	GRIDINDEX *index = isTexturedGridIndexed(countX, countY, detail) ? getTexturedGridIndex(dc, grid, detail) : NULL;
+
+	// the quads get the same texture coordinates as the indexed grid vertices
+	if( index == NULL ) {
+		const DRAWCONSTANTS *constants = &dc->constants;
+
+		for( int i=0; i<countX-1; ++i ) {
+			float tu0 = getTileEdgeUV(constants, txr->x, txr->width, detail, i%detail);
+			float tu1 = getTileEdgeUV(constants, txr->x, txr->width, detail, i%detail+1);
+
+			for( int j=0; j<countY-1; ++j ) {
+				float tv0 = getTileEdgeUV(constants, txr->y, txr->height, detail, j%detail);
+				float tv1 = getTileEdgeUV(constants, txr->y, txr->height, detail, j%detail+1);
+				emitTexturedGridQuad(dc, ctx, grid, i, j, txr->handle, tu0, tu1, tv0, tv1);
+			}
+		}
+		return;
+	}
+
+	// the staging buffer is reused for the grid vertices
+	flushDrawBatch(dc, ctx);
+
+	if( convertTexturedGrid(dc, dc->batchVertices, index, grid, txr, detail) ) {
+		drawIndexedGrid(ctx, dc->batchVertices, index->axisX.expandedCount*index->axisY.expandedCount,
+						index->indices, index->indexCount, txr->handle);
+	}
+}
+
+BOOL buildTexturedFarMesh(DRAWCONTEXT *dc, GRIDMESH *mesh, GRID2D *grid, TEXTURE *txr, int detail) {
+	if( grid->countX < 2 || grid->countY < 2 || detail < 1 )
+		return FALSE;
+
+	GRIDINDEX *index = getTexturedGridIndex(dc, grid, detail);
+	if( index == NULL )
+		return FALSE;
+
+	int vertexCount = index->axisX.expandedCount*index->axisY.expandedCount;
+	size_t size = sizeof(D3DTLVERTEX)*vertexCount + sizeof(WORD)*index->indexCount + VERTEX_ALIGNMENT;
+
+	if( size > mesh->capacity ) {
+		free(mesh->memory);
+		mesh->memory = malloc(size);
+		mesh->capacity = mesh->memory ? size : 0;
+		countAllocation(size);
+		if( mesh->memory == NULL )
+			return FALSE;
+	}
+
+	mesh->vertices = (D3DTLVERTEX *)(((size_t)mesh->memory + VERTEX_ALIGNMENT - 1) & ~(size_t)(VERTEX_ALIGNMENT - 1));
+	mesh->indices = (WORD *)&mesh->vertices[vertexCount];
+	mesh->vertexCount = vertexCount;
+	mesh->indexCount = index->indexCount;
+	mesh->textureHandle = txr->handle;
+	memcpy(mesh->indices, index->indices, sizeof(WORD)*index->indexCount);
+	return convertTexturedGrid(dc, mesh->vertices, index, grid, txr, detail);
+}
+
+void renderGridMesh(DRAWCONTEXT *dc, TR2CONTEXT *ctx, GRIDMESH *mesh) {
+	if( mesh->vertexCount == 0 )
+		return;
+
+	flushDrawBatch(dc, ctx);
+	drawIndexedGrid(ctx, mesh->vertices, mesh->vertexCount, mesh->indices, mesh->indexCount, mesh->textureHandle);
+}
+
+void freeGridMesh(GRIDMESH *mesh) {
+	free(mesh->memory);
+	memset(mesh, 0, sizeof(GRIDMESH));
 }
 
 /** @} */
@@ -35,8 +35,14 @@
  * @{
  */
 
+#include <math.h>
+#include <stddef.h>
 #include "intMath.h"
 
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif // M_PI
+
 /// Sines integer representation table for angle 0..90 degrees
 static const short intSinTable[0x401] = {
 	0x0000, 0x0019, 0x0032, 0x004B, 0x0065, 0x007E, 0x0097, 0x00B0,
@@ -170,31 +176,175 @@ static const short intSinTable[0x401] = {
 	0x4000,
 };
 
+/// Sines integer representation table for every angle 0..90 degrees (built by setIntSinVariant())
+static short intSinQuarterTable[0x4001];
+/// Quarter wave table is built
+static BOOL isQuarterTableReady = FALSE;
+/// Sines integer representation table for every angle of the full period by the selected variant (gathered by the batch functions)
+static short intSinFullTable[0x10000];
+/// Variant the full period table is built for (ISV_COUNT if it is not built)
+static INTSINVARIANT fullTableVariant = ISV_COUNT;
+/// Table variant of the batch functions
+static INTSINVARIANT sinVariant = ISV_NEAREST;
+
 int mulDiv(int number, int numerator, int denominator) {
-	int result = (long)number*numerator/denominator;
+	long long product = (long long)number*numerator; // long is 32-bit on Win32
+	int result = product/denominator;
 
-	if( (unsigned long)number*numerator%denominator*2 >= (unsigned long)denominator )
+	// the products of the 32-bit range are rounded by the 32-bit unsigned remainder, as they were
+	// before the product became 64-bit (it matters for the negative products and denominators)
+	if( product >= -0x80000000LL && product <= 0x7FFFFFFFLL ) {
+		if( (DWORD)product%(DWORD)denominator*2 >= (DWORD)denominator )
+			result++;
+	} else if( (unsigned long long)product%denominator*2 >= (unsigned long long)denominator ) {
 		result++;
-
+	}
 	return result;
 }
 
-short intSin(unsigned short angle) {
-	unsigned short sector = angle & 0x7FFF; // sector range will be: 0..0x7FFF (0..179.99 degrees)
+// the reciprocal is ceil(2^(32+log)/divisor) - 2^32, where log is ceil(log2(divisor)),
+// so the quotient is (t + ((number - t) >> 1)) >> (log - 1), where t is the high part of the reciprocal product
+void initDivider(DIVIDER *divider, DWORD divisor) {
+	int log = 0;
+
+	while( ((unsigned long long)1 << log) < divisor )
+		++log;
 
-	if( sector > 0x4000 )
-		sector = 0x8000 - sector; // sector range will be: 0x0000..0x4000 (0..90 degrees)
+	divider->divisor = divisor;
+	divider->multiplier = (DWORD)((((unsigned long long)1 << 32) * (((unsigned long long)1 << log) - divisor)) / divisor + 1);
+	divider->shift1 = ( log > 0 ) ? 1 : 0;
+	divider->shift2 = ( log > 0 ) ? log-1 : 0;
+}
 
-	short result = intSinTable[sector/16];
+DWORD divideBy(const DIVIDER *divider, DWORD number) {
+	DWORD t = (DWORD)(((unsigned long long)divider->multiplier * number) >> 32);
+	return (t + ((number - t) >> divider->shift1)) >> divider->shift2;
+}
 
-	if( angle >= 0x8000 )
-		result = -result;
+int mulDivBy(int number, int numerator, const DIVIDER *divider) {
+	// rounding to the nearest is the same as adding half of the divisor before the division
+	unsigned long long product = (unsigned long long)(DWORD)number * (DWORD)numerator + divider->divisor/2;
 
-	return result;
+	if( product > 0xFFFFFFFFu )
+		return product / divider->divisor;
+	return divideBy(divider, (DWORD)product);
+}
+
+// gets sines without branches. The second and the fourth quarters are folded to the first
+// one by the mask (0x4000 - sector), the sign is applied by the mask too
+static short foldSin(unsigned angle) {
+	int sector = angle & 0x3FFF; // sector range will be: 0..0x3FFF (0..89.99 degrees)
+	int fold = -(int)((angle >> 14) & 1); // second and fourth quarters
+	int sign = -(int)((angle >> 15) & 1); // third and fourth quarters
+
+	sector = ((sector ^ fold) + (fold & 0x4001)) >> 4; // sector range will be: 0..0x400 (table index)
+	return (intSinTable[sector] ^ sign) - sign;
+}
+
+// same as foldSin(), but the table is interpolated linearly between the entries
+static short foldSinLinear(unsigned angle) {
+	int sector = angle & 0x3FFF;
+	int fold = -(int)((angle >> 14) & 1);
+	int sign = -(int)((angle >> 15) & 1);
+
+	sector = (sector ^ fold) + (fold & 0x4001); // sector range will be: 0..0x4000 (exact mirror)
+	int index = sector >> 4;
+	int next = index + (index < 0x400);
+	int result = intSinTable[index] + (((intSinTable[next] - intSinTable[index]) * (sector & 15) + 8) >> 4);
+	return (result ^ sign) - sign;
+}
+
+// same as foldSin(), but every angle has its own entry of the quarter wave table
+static short foldSinQuarter(unsigned angle) {
+	int sector = angle & 0x3FFF;
+	int fold = -(int)((angle >> 14) & 1);
+	int sign = -(int)((angle >> 15) & 1);
+
+	sector = (sector ^ fold) + (fold & 0x4001);
+	return (intSinQuarterTable[sector] ^ sign) - sign;
+}
+
+// builds the full period table by the selected variant, so the batch functions have no quadrant folding
+static void buildFullTable(void) {
+	for( int i=0; i<0x10000; ++i )
+		intSinFullTable[i] = intSinVariant((unsigned short)i, sinVariant);
+	fullTableVariant = sinVariant;
+}
+
+// returns the full period table, it is built on the first use if initIntMath() has not been called
+static const short *getFullTable(void) {
+	if( fullTableVariant != sinVariant )
+		buildFullTable();
+	return intSinFullTable;
+}
+
+short intSin(unsigned short angle) {
+	return foldSin(angle);
 }
 
 short intCos(unsigned short angle) {
-	return intSin(angle + 0x4000);
+	return foldSin((unsigned short)(angle + 0x4000));
+}
+
+short intSinVariant(unsigned short angle, INTSINVARIANT variant) {
+	switch( variant ) {
+		case ISV_LINEAR :
+			return foldSinLinear(angle);
+		case ISV_QUARTER :
+			return isQuarterTableReady ? foldSinQuarter(angle) : foldSin(angle);
+		default :
+			return foldSin(angle);
+	}
+}
+
+void setIntSinVariant(INTSINVARIANT variant) {
+	if( variant == ISV_QUARTER && !isQuarterTableReady ) {
+		for( int i=0; i<=0x4000; ++i )
+			intSinQuarterTable[i] = (short)floor(sin((double)i * M_PI / 2.0 / 0x4000) * 0x4000 + 0.5);
+		isQuarterTableReady = TRUE;
+	}
+	if( variant < 0 || variant >= ISV_COUNT )
+		variant = ISV_NEAREST;
+	sinVariant = variant;
+	buildFullTable();
+}
+
+void initIntMath(void) {
+	if( fullTableVariant != sinVariant )
+		buildFullTable();
+}
+
+INTSINVARIANT getIntSinVariant(void) {
+	return sinVariant;
+}
+
+void intSinCosBatch(const unsigned short *angles, short *sinOut, short *cosOut, int count) {
+	const short *table = getFullTable();
+
+	if( sinOut != NULL ) {
+		for( int i=0; i<count; ++i )
+			sinOut[i] = table[angles[i]];
+	}
+	if( cosOut != NULL ) {
+		for( int i=0; i<count; ++i )
+			cosOut[i] = table[(unsigned short)(angles[i] + 0x4000)];
+	}
+}
+
+void intSinCosStrided(unsigned short start, unsigned short step, short *sinOut, short *cosOut, int count) {
+	const short *table = getFullTable();
+	unsigned short angle;
+
+	if( sinOut != NULL ) {
+		angle = start;
+		for( int i=0; i<count; ++i, angle += step )
+			sinOut[i] = table[angle];
+	}
+	if( cosOut != NULL ) {
+		angle = start + 0x4000;
+		for( int i=0; i<count; ++i, angle += step )
+			cosOut[i] = table[angle];
+	}
 }
 
 /** @} */
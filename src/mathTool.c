@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Integer maths benchmark tool
+ *
+ * This file implements command line tool verifying accuracy and measuring
+ * throughput of the integer maths functions
+ */
+
+/**
+ * @addtogroup INTEGER_MATHS
+ *
+ * @{
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intMath.h"
+
+#ifndef M_PI
+#define M_PI (3.14159265358979323846)
+#endif // M_PI
+
+/// Number of angle integer representations
+#define ANGLE_COUNT		(0x10000)
+/// Default number of passes over all angles per throughput measurement
+#define MATH_REPEATS	(200)
+/// Number of mulDiv argument sets
+#define MULDIV_COUNT	(0x10000)
+
+/// Names of the sine table variants
+static const char *variantNames[ISV_COUNT] = {
+	"nearest",
+	"linear",
+	"quarter",
+};
+
+#ifdef _WIN32
+static double getSeconds(void) {
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+#else // _WIN32
+#include <time.h>
+static double getSeconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+#endif // _WIN32
+
+/// Sink of the measured results, so the loops are not optimized out
+static volatile int resultSink;
+
+// prints max and RMS error of sines and cosines (units of 1/0x4000) against libm
+static void printSinAccuracy(const char *function, INTSINVARIANT variant) {
+	static short sines[ANGLE_COUNT], cosines[ANGLE_COUNT];
+	double maxError = 0.0, sumSquares = 0.0;
+	int exactCount = 0;
+
+	setIntSinVariant(variant);
+	intSinCosStrided(0, 1, sines, cosines, ANGLE_COUNT);
+
+	for( int i=0; i<ANGLE_COUNT; ++i ) {
+		double angle = (double)i * 2.0 * M_PI / ANGLE_COUNT;
+		double errors[2] = {
+			sines[i] - sin(angle) * 0x4000,
+			cosines[i] - cos(angle) * 0x4000,
+		};
+		for( int k=0; k<2; ++k ) {
+			if( fabs(errors[k]) > maxError )
+				maxError = fabs(errors[k]);
+			if( fabs(errors[k]) <= 0.5 )
+				++exactCount;
+			sumSquares += errors[k] * errors[k];
+		}
+	}
+	printf("%s,%s,%.3f,%.3f,%.2f\n", function, variantNames[variant],
+		   maxError, sqrt(sumSquares / (ANGLE_COUNT*2)), 100.0 * exactCount / (ANGLE_COUNT*2));
+}
+
+// returns random number 0..maxValue
+static int getRandom(int maxValue) {
+	return (int)((double)rand() / RAND_MAX * maxValue);
+}
+
+// prints number of mulDiv results different from the exact rounded result.
+// The arguments are chosen so the result fits 31 bits, the product may not
+static void printMulDivAccuracy(const char *range, int maxNumber, int maxNumerator) {
+	int errorCount = 0;
+
+	srand(1);
+	for( int i=0; i<MULDIV_COUNT; ++i ) {
+		int number, numerator, denominator;
+		long long exact;
+		do {
+			number = getRandom(maxNumber);
+			numerator = getRandom(maxNumerator);
+			denominator = 1 + getRandom(maxNumerator - 1);
+			exact = ((long long)number * numerator * 2 + denominator) / ((long long)denominator * 2);
+		} while( exact > 0x7FFFFFFF );
+
+		if( mulDiv(number, numerator, denominator) != exact )
+			++errorCount;
+	}
+	printf("mulDiv,%s,%d,%d\n", range, MULDIV_COUNT, errorCount);
+}
+
+// returns mulDiv result by the 32-bit product, as it was calculated before the product became 64-bit
+static int mulDiv32(int number, int numerator, int denominator) {
+	int product = (int)((DWORD)number * (DWORD)numerator);
+	int result = product / denominator;
+
+	if( (DWORD)product % (DWORD)denominator * 2 >= (DWORD)denominator )
+		result++;
+	return result;
+}
+
+// prints number of mulDiv results different from the 32-bit product ones. The arguments
+// may be negative, and they are chosen so the product fits 32 bits
+static void printMulDivLegacy(void) {
+	int errorCount = 0;
+
+	srand(1);
+	for( int i=0; i<MULDIV_COUNT; ++i ) {
+		int number = getRandom(0xFFFE) - 0x7FFF;
+		int numerator = getRandom(0xFFFE) - 0x7FFF;
+		int denominator = 1 + getRandom(0x7FFE);
+		if( i & 1 )
+			denominator = -denominator;
+
+		if( mulDiv(number, numerator, denominator) != mulDiv32(number, numerator, denominator) )
+			++errorCount;
+	}
+	printf("mulDiv,legacy,%d,%d\n", MULDIV_COUNT, errorCount);
+}
+
+// prints number of divider results different from the division ones
+static void printDividerAccuracy(void) {
+	static const DWORD edgeDivisors[] = {1, 2, 3, 5, 6, 7, 641, 0x7FFFFFFF, 0x80000000, 0x80000001, 0xFFFFFFFF};
+	static const DWORD edgeNumbers[] = {0, 1, 2, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFE, 0xFFFFFFFF};
+	int sampleCount = 0, errorCount = 0, mulDivErrorCount = 0;
+	DIVIDER divider;
+
+	srand(2);
+	for( unsigned i=0; i<sizeof(edgeDivisors)/sizeof(DWORD) + 0x1000; ++i ) {
+		DWORD divisor = ( i < sizeof(edgeDivisors)/sizeof(DWORD) ) ? edgeDivisors[i] : 1 + ((DWORD)rand() << 17 ^ (DWORD)rand()) % ( i & 1 ? 0xFFFF : 0xFFFFFFFE );
+		initDivider(&divider, divisor);
+
+		for( unsigned k=0; k<sizeof(edgeNumbers)/sizeof(DWORD) + 0x100; ++k ) {
+			DWORD number = ( k < sizeof(edgeNumbers)/sizeof(DWORD) ) ? edgeNumbers[k] : (DWORD)rand() << 17 ^ (DWORD)rand() << 2 ^ (DWORD)rand();
+			if( divideBy(&divider, number) != number / divisor )
+				++errorCount;
+			++sampleCount;
+		}
+		if( divisor > 0x7FFFFFFF )
+			continue;
+		for( int k=0; k<0x40; ++k ) {
+			int number = getRandom(0x7FFFFFFF);
+			int numerator = getRandom(divisor);
+			if( mulDivBy(number, numerator, &divider) != mulDiv(number, numerator, divisor) )
+				++mulDivErrorCount;
+		}
+	}
+	printf("divideBy,all,%d,%d\n", sampleCount, errorCount);
+	printf("mulDivBy,all,%d,%d\n", 0x40 * 0x1000, mulDivErrorCount);
+}
+
+// prints nanoseconds per call of the scalar functions
+static void printScalarThroughput(int repeats) {
+	double startTime = getSeconds();
+	int sum = 0;
+	for( int r=0; r<repeats; ++r ) {
+		unsigned short angle = r;
+		for( int i=0; i<ANGLE_COUNT; ++i, angle += 0x3001 )
+			sum += intSin(angle);
+	}
+	double sinTime = getSeconds() - startTime;
+
+	startTime = getSeconds();
+	for( int r=0; r<repeats; ++r ) {
+		for( int i=0; i<ANGLE_COUNT; ++i )
+			sum += mulDiv(i, 1920*16 + r, 1080 + (i & 0xFF));
+	}
+	double mulDivTime = getSeconds() - startTime;
+
+	startTime = getSeconds();
+	for( int r=0; r<repeats; ++r ) {
+		DIVIDER dividers[0x100];
+		for( int k=0; k<0x100; ++k )
+			initDivider(&dividers[k], 1080 + k);
+		for( int i=0; i<ANGLE_COUNT; ++i )
+			sum += mulDivBy(i, 1920*16 + r, &dividers[i & 0xFF]);
+	}
+	double mulDivByTime = getSeconds() - startTime;
+	resultSink = sum;
+
+	printf("intSin,nearest,%.2f\n", sinTime * 1e9 / ((double)repeats * ANGLE_COUNT));
+	printf("mulDiv,-,%.2f\n", mulDivTime * 1e9 / ((double)repeats * ANGLE_COUNT));
+	printf("mulDivBy,-,%.2f\n", mulDivByTime * 1e9 / ((double)repeats * ANGLE_COUNT));
+}
+
+// prints nanoseconds per sine of the strided and the batch functions
+static void printBatchThroughput(INTSINVARIANT variant, int repeats) {
+	static unsigned short angles[ANGLE_COUNT];
+	static short sines[ANGLE_COUNT];
+
+	setIntSinVariant(variant);
+	for( int i=0; i<ANGLE_COUNT; ++i )
+		angles[i] = (unsigned short)(i * 0x3001);
+
+	double startTime = getSeconds();
+	for( int r=0; r<repeats; ++r ) {
+		intSinCosStrided(r, 0x3001, sines, NULL, ANGLE_COUNT);
+		resultSink = sines[r];
+	}
+	double stridedTime = getSeconds() - startTime;
+
+	startTime = getSeconds();
+	for( int r=0; r<repeats; ++r ) {
+		intSinCosBatch(angles, sines, NULL, ANGLE_COUNT);
+		resultSink = sines[r];
+	}
+	double batchTime = getSeconds() - startTime;
+
+	printf("intSinCosStrided,%s,%.2f\n", variantNames[variant], stridedTime * 1e9 / ((double)repeats * ANGLE_COUNT));
+	printf("intSinCosBatch,%s,%.2f\n", variantNames[variant], batchTime * 1e9 / ((double)repeats * ANGLE_COUNT));
+}
+
+// checks that the default batch results are the same as intSin() and intCos() ones
+static int countBatchMismatches(void) {
+	static short sines[ANGLE_COUNT], cosines[ANGLE_COUNT];
+	int count = 0;
+
+	setIntSinVariant(ISV_NEAREST);
+	intSinCosStrided(0, 1, sines, cosines, ANGLE_COUNT);
+	for( int i=0; i<ANGLE_COUNT; ++i ) {
+		if( sines[i] != intSin(i) || cosines[i] != intCos(i) )
+			++count;
+	}
+	return count;
+}
+
+static void printUsage(void) {
+	printf("Usage: tr2mathbench [options]\n"
+		   "  -repeats N   passes over all angles per throughput case (default: %d)\n", MATH_REPEATS);
+}
+
+int main(int argc, char *argv[]) {
+	int repeats = MATH_REPEATS;
+
+	for( int i=1; i<argc; ++i ) {
+		if( !strcmp(argv[i], "-repeats") && i+1 < argc )
+			repeats = atoi(argv[++i]);
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+	if( repeats <= 0 ) {
+		printUsage();
+		return 1;
+	}
+
+	int mismatches = countBatchMismatches();
+	printf("check,batch_vs_intSin,%d\n", mismatches);
+
+	printf("function,variant,max_error,rms_error,exact_percent\n");
+	for( int i=0; i<ISV_COUNT; ++i )
+		printSinAccuracy("intSinCos", i);
+
+	printf("function,range,samples,errors\n");
+	printMulDivAccuracy("16bit", 0x7FFF, 0x7FFF);
+	printMulDivAccuracy("screen", 7680*16, 0x7FFF);
+	printMulDivAccuracy("31bit", 0x7FFFFFFF, 0x7FFFFFFF);
+	printMulDivLegacy();
+	printDividerAccuracy();
+
+	printf("function,variant,ns_per_call\n");
+	printScalarThroughput(repeats);
+	for( int i=0; i<ISV_COUNT; ++i )
+		printBatchThroughput(i, repeats);
+
+	setIntSinVariant(ISV_NEAREST);
+	return ( mismatches == 0 ) ? 0 : 1;
+}
+
+/** @} */
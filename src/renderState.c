@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Render state cache
+ *
+ * This file implements shadow table of the device render states
+ */
+
+/**
+ * @defgroup RENDER_STATE Render state
+ * @brief Render state cache
+ *
+ * This module contains shadow table of the device render states.
+ * The library records wanted states and sends only the changed ones
+ * right before a draw. The game reports the states it sets by itself,
+ * and may query the states applied by the library, so neither side
+ * sets a state which is already applied
+ *
+ * @{
+ */
+
+#include "drawStats.h"
+#include "renderState.h"
+
+/// Number of bits in the dirty/known bit masks
+#define MASK_BITS	(32)
+/// Number of words in the dirty/known bit masks
+#define MASK_WORDS	(RENDER_STATE_COUNT / MASK_BITS)
+
+/// Render state shadow table
+typedef struct {
+	DWORD value[RENDER_STATE_COUNT];	///< Recorded values
+	DWORD applied[RENDER_STATE_COUNT];	///< Values applied to the device
+	DWORD dirty[MASK_WORDS];	///< Bit mask of the states to be sent
+	DWORD known[MASK_WORDS];	///< Bit mask of the states whose applied values are known
+} RENDERSTATES;
+
+static RENDERSTATES states;
+
+#define STATE_BIT(state)	(1ul << ((state) % MASK_BITS))
+#define STATE_WORD(state)	((state) / MASK_BITS)
+
+static BOOL isValidState(D3DRENDERSTATETYPE state) {
+	return ( state >= 0 && state < RENDER_STATE_COUNT );
+}
+
+static D3DRENDERSTATETYPE alphaStateType(TR2CONTEXT *ctx) {
+	return *ctx->pAlphaBlendAvailable ? D3DRENDERSTATE_ALPHABLENDENABLE : D3DRENDERSTATE_COLORKEYENABLE;
+}
+
+void setRenderState(D3DRENDERSTATETYPE state, DWORD value) {
+	if( !isValidState(state) )
+		return;
+
+	// the change is elided if the value is already applied, or the pending value is overridden
+	if( states.dirty[STATE_WORD(state)] & STATE_BIT(state) )
+		countRenderStates(0, 1);
+
+	states.value[state] = value;
+	if( (states.known[STATE_WORD(state)] & STATE_BIT(state)) && states.applied[state] == value ) {
+		if( !(states.dirty[STATE_WORD(state)] & STATE_BIT(state)) )
+			countRenderStates(0, 1);
+		states.dirty[STATE_WORD(state)] &= ~STATE_BIT(state);
+	} else {
+		states.dirty[STATE_WORD(state)] |= STATE_BIT(state);
+	}
+}
+
+DWORD getRenderState(D3DRENDERSTATETYPE state) {
+	return isValidState(state) ? states.value[state] : 0;
+}
+
+void flushRenderStates(TR2CONTEXT *ctx) {
+	D3DRENDERSTATETYPE alphaState = alphaStateType(ctx);
+
+	for( int i=0; i<MASK_WORDS; ++i ) {
+		DWORD mask = states.dirty[i];
+		if( mask == 0 )
+			continue;
+
+		for( int j=0; mask != 0; ++j, mask >>= 1 ) {
+			if( (mask & 1) == 0 )
+				continue;
+
+			D3DRENDERSTATETYPE state = i*MASK_BITS + j;
+			DWORD value = states.value[state];
+
+			(**ctx->pDxDevice)->SetRenderState(*ctx->pDxDevice, state, value);
+			states.applied[state] = value;
+			countRenderStates(1, 0);
+
+			if( state == D3DRENDERSTATE_TEXTUREHANDLE )
+				*ctx->pCurrentTextureHandle = value;
+			else if( state == alphaState )
+				*ctx->pCurrentAlphaState = value;
+		}
+		states.known[i] |= states.dirty[i];
+		states.dirty[i] = 0;
+	}
+}
+
+void importHostRenderStates(TR2CONTEXT *ctx) {
+	syncRenderState(D3DRENDERSTATE_TEXTUREHANDLE, *ctx->pCurrentTextureHandle);
+	syncRenderState(alphaStateType(ctx), *ctx->pCurrentAlphaState);
+}
+
+void syncRenderState(D3DRENDERSTATETYPE state, DWORD value) {
+	if( !isValidState(state) )
+		return;
+
+	states.value[state] = value;
+	states.applied[state] = value;
+	states.known[STATE_WORD(state)] |= STATE_BIT(state);
+	states.dirty[STATE_WORD(state)] &= ~STATE_BIT(state);
+}
+
+BOOL getAppliedRenderState(D3DRENDERSTATETYPE state, DWORD *value) {
+	if( !isValidState(state) || !(states.known[STATE_WORD(state)] & STATE_BIT(state)) )
+		return FALSE;
+
+	if( value != NULL )
+		*value = states.applied[state];
+	return TRUE;
+}
+
+void invalidateRenderStates(void) {
+	for( int i=0; i<MASK_WORDS; ++i ) {
+		states.dirty[i] |= states.known[i];
+		states.known[i] = 0;
+	}
+}
+
+/** @} */
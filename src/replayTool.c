@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Capture replay tool
+ *
+ * This file implements command line tool replaying the capture file
+ * to the software device (or the null device) at full speed
+ */
+
+/**
+ * @addtogroup CAPTURE
+ *
+ * @{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "capture.h"
+#include "softDevice.h"
+
+#ifdef _WIN32
+static double getSeconds(void) {
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+#else // _WIN32
+#include <time.h>
+static double getSeconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+#endif // _WIN32
+
+static void printUsage(void) {
+	printf("Usage: tr2replay <capture file> [options]\n"
+		   "  -frame N   replay frame N only (default: all frames)\n"
+		   "  -loop N    replay N times (default: 1)\n"
+		   "  -null      replay to the null device (no rasterization)\n"
+		   "  -image F   save the last replayed frame as PPM image\n");
+}
+
+int main(int argc, char *argv[]) {
+	int frame = -1;
+	int loopCount = 1;
+	BOOL nullDevice = FALSE;
+	const char *imageName = NULL;
+
+	if( argc < 2 ) {
+		printUsage();
+		return 1;
+	}
+
+	for( int i=2; i<argc; ++i ) {
+		if( !strcmp(argv[i], "-frame") && i+1 < argc )
+			frame = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-loop") && i+1 < argc )
+			loopCount = atoi(argv[++i]);
+		else if( !strcmp(argv[i], "-null") )
+			nullDevice = TRUE;
+		else if( !strcmp(argv[i], "-image") && i+1 < argc )
+			imageName = argv[++i];
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+
+	REPLAY *replay = openReplay(argv[1]);
+	if( replay == NULL ) {
+		fprintf(stderr, "Cannot open capture file %s\n", argv[1]);
+		return 1;
+	}
+
+	int frameCount = getReplayFrameCount(replay);
+	int firstFrame = ( frame < 0 ) ? 0 : frame;
+	int lastFrame = ( frame < 0 ) ? frameCount-1 : frame;
+	const CAPTUREFRAME *info = getReplayFrame(replay, firstFrame);
+	if( info == NULL ) {
+		fprintf(stderr, "There is no frame %d (%d frames captured)\n", firstFrame, frameCount);
+		closeReplay(replay);
+		return 1;
+	}
+
+	SOFTDEVICE *device = nullDevice ? createSoftDevice(0, 0) : createSoftDevice(info->screenWidth, info->screenHeight);
+	if( device == NULL ) {
+		fprintf(stderr, "Cannot create device\n");
+		closeReplay(replay);
+		return 1;
+	}
+
+	long long commandCount = 0;
+	double startTime = getSeconds();
+	for( int loop=0; loop<loopCount; ++loop ) {
+		for( int i=firstFrame; i<=lastFrame; ++i )
+			commandCount += replayFrame(replay, i, (LPDIRECT3DDEVICE2 *)device);
+	}
+	double elapsed = getSeconds() - startTime;
+	int replayed = (lastFrame - firstFrame + 1) * loopCount;
+
+	printf("frames=%d commands=%lld draws=%u vertices=%u triangles=%u time=%.6f ns_per_frame=%.0f checksum=%08X\n",
+		   replayed, commandCount, device->drawPrimitiveCount, device->vertexCount, device->triangleCount,
+		   elapsed, replayed ? elapsed * 1e9 / replayed : 0.0, getSoftDeviceChecksum(device));
+
+	if( imageName != NULL && !saveSoftDeviceImage(device, imageName) )
+		fprintf(stderr, "Cannot save image %s\n", imageName);
+
+	destroySoftDevice(device);
+	closeReplay(replay);
+	return 0;
+}
+
+/** @} */
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Shared lock
+ *
+ * This file implements the lock of the state shared by all wallpaper instances
+ */
+
+/**
+ * @defgroup SHARED_LOCK Shared lock
+ * @brief Lock of the shared state
+ *
+ * This module contains the recursive lock of the state that is not owned
+ * by the wallpaper instances. The instances generate their grids without
+ * it, and take it only to submit the draws and to touch the shared modules,
+ * so the instances may be drawn by several threads at once. The lock is
+ * created by DllMain on the library loading, and by the tools on start
+ *
+ * @{
+ */
+
+#include "sharedLock.h"
+
+/// Shared state lock
+static CRITICAL_SECTION sharedLock;
+
+void initSharedLock(void) {
+	InitializeCriticalSection(&sharedLock);
+}
+
+void freeSharedLock(void) {
+	DeleteCriticalSection(&sharedLock);
+}
+
+void lockSharedState(void) {
+	EnterCriticalSection(&sharedLock);
+}
+
+void unlockSharedState(void) {
+	LeaveCriticalSection(&sharedLock);
+}
+
+/** @} */
@@ -0,0 +1,477 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Software device
+ *
+ * This file implements headless software rasterizer implementing
+ * IDirect3DDevice2 interface, and the context factory for it
+ */
+
+/**
+ * @defgroup SOFT_DEVICE Software device
+ * @brief Headless software rasterizer
+ *
+ * This module contains software implementation of the IDirect3DDevice2
+ * methods used by the library. It draws transformed and lit vertices
+ * to the memory frame buffer, so the renderer may be measured and
+ * checked for pixel-exact output without the game and the video card.
+ * The rasterizer uses 28.4 fixed point edge functions with top-left
+ * fill rule, so the output does not depend on the triangle order
+ *
+ * @{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "softDevice.h"
+
+/// Subpixel precision of the rasterizer (bits)
+#define SUBPIXEL_BITS	(4)
+/// Subpixel precision of the rasterizer (factor)
+#define SUBPIXEL_ONE	(1 << SUBPIXEL_BITS)
+
+/// Error returned for unsupported requests
+#define SOFT_E_INVALIDPARAMS	((HRESULT)0x80070057)
+
+// Render state values used by the rasterizer (DX5 SDK)
+#define CULL_NONE			(1)
+#define CULL_CW				(2)
+#define CULL_CCW			(3)
+#define CMP_NEVER			(1)
+#define CMP_LESS			(2)
+#define CMP_EQUAL			(3)
+#define CMP_LESSEQUAL		(4)
+#define CMP_GREATER			(5)
+#define CMP_NOTEQUAL		(6)
+#define CMP_GREATEREQUAL	(7)
+#define CMP_ALWAYS			(8)
+#define TBLEND_DECAL		(1)
+#define TBLEND_COPY			(7)
+
+/// Rasterizer vertex
+typedef struct {
+	int x;	///< X coordinate (28.4 fixed point)
+	int y;	///< Y coordinate (28.4 fixed point)
+	float z;	///< Normalized Z
+	float rhw;	///< Reciprocal of homogeneous w
+	float a, r, g, b;	///< Color components multiplied by rhw
+	float u, v;	///< Texture coordinates multiplied by rhw
+} RASTVERTEX;
+
+static HRESULT __stdcall softSetRenderState(struct IDirect3DDevice2 **This, D3DRENDERSTATETYPE state, DWORD value);
+static HRESULT __stdcall softDrawPrimitive(struct IDirect3DDevice2 **This, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType,
+										   LPVOID vertices, DWORD vertexCount, DWORD flags);
+static HRESULT __stdcall softDrawIndexedPrimitive(struct IDirect3DDevice2 **This, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType,
+												  LPVOID vertices, DWORD vertexCount, LPWORD indices, DWORD indexCount, DWORD flags);
+
+/// Software device interface. Unsupported methods are NULL
+static struct IDirect3DDevice2 softDeviceInterface = {
+	.SetRenderState = softSetRenderState,
+	.DrawPrimitive = softDrawPrimitive,
+	.DrawIndexedPrimitive = softDrawIndexedPrimitive,
+};
+
+static SOFTDEVICE *getDevice(struct IDirect3DDevice2 **This) {
+	return (SOFTDEVICE *)This;
+}
+
+static void setupVertex(RASTVERTEX *rv, D3DTLVERTEX *vtx) {
+	rv->x = (int)(vtx->sx * SUBPIXEL_ONE + (vtx->sx < 0 ? -0.5f : 0.5f));
+	rv->y = (int)(vtx->sy * SUBPIXEL_ONE + (vtx->sy < 0 ? -0.5f : 0.5f));
+	rv->z = vtx->sz;
+	rv->rhw = vtx->rhw;
+	rv->a = (float)RGBA_GETALPHA(vtx->color) * vtx->rhw;
+	rv->r = (float)RGBA_GETRED(vtx->color)   * vtx->rhw;
+	rv->g = (float)RGBA_GETGREEN(vtx->color) * vtx->rhw;
+	rv->b = (float)RGBA_GETBLUE(vtx->color)  * vtx->rhw;
+	rv->u = vtx->tu * vtx->rhw;
+	rv->v = vtx->tv * vtx->rhw;
+}
+
+static BOOL compareZ(DWORD func, float z, float zBuf) {
+	switch( func ) {
+		case CMP_NEVER :		return FALSE;
+		case CMP_LESS :			return z <  zBuf;
+		case CMP_EQUAL :		return z == zBuf;
+		case CMP_LESSEQUAL :	return z <= zBuf;
+		case CMP_GREATER :		return z >  zBuf;
+		case CMP_NOTEQUAL :		return z != zBuf;
+		case CMP_GREATEREQUAL :	return z >= zBuf;
+		default :				return TRUE;
+	}
+}
+
+static int clampColor(float value) {
+	int result = (int)(value + 0.5f);
+	if( result < 0x00 ) result = 0x00;
+	if( result > 0xFF ) result = 0xFF;
+	return result;
+}
+
+// top-left fill rule: pixels exactly on the other edges are not drawn
+static BOOL isTopLeftEdge(RASTVERTEX *v0, RASTVERTEX *v1) {
+	return ( v1->y < v0->y || (v1->y == v0->y && v1->x > v0->x) );
+}
+
+static long long edgeFunction(RASTVERTEX *v0, RASTVERTEX *v1, int px, int py) {
+	return (long long)(v1->x - v0->x) * (py - v0->y) - (long long)(v1->y - v0->y) * (px - v0->x);
+}
+
+static void shadePixel(SOFTDEVICE *dev, int offset, float rhw, float z, float a, float r, float g, float b, float u, float v) {
+	DWORD *rs = dev->renderStates;
+
+	if( rs[D3DRENDERSTATE_ZENABLE] && !compareZ(rs[D3DRENDERSTATE_ZFUNC], z, dev->zBuffer[offset]) )
+		return;
+
+	float w = 1.0f / rhw;
+	float ca = a*w, cr = r*w, cg = g*w, cb = b*w;
+	DWORD handle = rs[D3DRENDERSTATE_TEXTUREHANDLE];
+
+	if( handle > 0 && handle <= SOFT_MAX_PAGES && dev->pages[handle-1] != NULL ) {
+		int tx = (int)(u*w*SOFT_PAGE_SIZE) & (SOFT_PAGE_SIZE-1);
+		int ty = (int)(v*w*SOFT_PAGE_SIZE) & (SOFT_PAGE_SIZE-1);
+		D3DCOLOR texel = dev->pages[handle-1][ty*SOFT_PAGE_SIZE+tx];
+
+		if( rs[D3DRENDERSTATE_COLORKEYENABLE] && RGBA_GETALPHA(texel) == 0 )
+			return;
+
+		if( rs[D3DRENDERSTATE_TEXTUREMAPBLEND] == TBLEND_DECAL || rs[D3DRENDERSTATE_TEXTUREMAPBLEND] == TBLEND_COPY ) {
+			ca = RGBA_GETALPHA(texel);
+			cr = RGBA_GETRED(texel);
+			cg = RGBA_GETGREEN(texel);
+			cb = RGBA_GETBLUE(texel);
+		} else {
+			ca = ca * RGBA_GETALPHA(texel) / 255.0f;
+			cr = cr * RGBA_GETRED(texel)   / 255.0f;
+			cg = cg * RGBA_GETGREEN(texel) / 255.0f;
+			cb = cb * RGBA_GETBLUE(texel)  / 255.0f;
+		}
+	}
+
+	if( rs[D3DRENDERSTATE_ALPHABLENDENABLE] ) {
+		D3DCOLOR dst = dev->frameBuffer[offset];
+		float srcFactor = ca / 255.0f;
+		cr = cr * srcFactor + RGBA_GETRED(dst)   * (1.0f - srcFactor);
+		cg = cg * srcFactor + RGBA_GETGREEN(dst) * (1.0f - srcFactor);
+		cb = cb * srcFactor + RGBA_GETBLUE(dst)  * (1.0f - srcFactor);
+	}
+
+	dev->frameBuffer[offset] = RGBA_MAKE(clampColor(cr), clampColor(cg), clampColor(cb), clampColor(ca));
+	if( rs[D3DRENDERSTATE_ZENABLE] && rs[D3DRENDERSTATE_ZWRITEENABLE] )
+		dev->zBuffer[offset] = z;
+}
+
+static void drawTriangle(SOFTDEVICE *dev, D3DTLVERTEX *vtx0, D3DTLVERTEX *vtx1, D3DTLVERTEX *vtx2) {
+	RASTVERTEX rv[3];
+	RASTVERTEX *v0 = &rv[0], *v1 = &rv[1], *v2 = &rv[2];
+
+	++dev->triangleCount;
+	if( dev->frameBuffer == NULL )
+		return; // null device
+
+	setupVertex(v0, vtx0);
+	setupVertex(v1, vtx1);
+	setupVertex(v2, vtx2);
+
+	long long area = edgeFunction(v0, v1, v2->x, v2->y);
+	if( area == 0 )
+		return;
+
+	// positive area is clockwise on the screen (Y axis is pointing down)
+	if( (area < 0 && dev->renderStates[D3DRENDERSTATE_CULLMODE] == CULL_CCW)
+		|| (area > 0 && dev->renderStates[D3DRENDERSTATE_CULLMODE] == CULL_CW) )
+	{
+		return;
+	}
+
+	if( area < 0 ) {
+		RASTVERTEX *tmp = v1;
+		v1 = v2;
+		v2 = tmp;
+		area = -area;
+	}
+
+	int minX = v0->x, maxX = v0->x, minY = v0->y, maxY = v0->y;
+	if( v1->x < minX ) minX = v1->x;
+	if( v2->x < minX ) minX = v2->x;
+	if( v1->x > maxX ) maxX = v1->x;
+	if( v2->x > maxX ) maxX = v2->x;
+	if( v1->y < minY ) minY = v1->y;
+	if( v2->y < minY ) minY = v2->y;
+	if( v1->y > maxY ) maxY = v1->y;
+	if( v2->y > maxY ) maxY = v2->y;
+
+	// pixel centers have integer coordinates
+	minX = (minX + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+	minY = (minY + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS;
+	maxX = maxX >> SUBPIXEL_BITS;
+	maxY = maxY >> SUBPIXEL_BITS;
+	if( minX < 0 ) minX = 0;
+	if( minY < 0 ) minY = 0;
+	if( maxX > dev->width-1 ) maxX = dev->width-1;
+	if( maxY > dev->height-1 ) maxY = dev->height-1;
+	if( minX > maxX || minY > maxY )
+		return;
+
+	long long bias0 = isTopLeftEdge(v1, v2) ? 0 : -1;
+	long long bias1 = isTopLeftEdge(v2, v0) ? 0 : -1;
+	long long bias2 = isTopLeftEdge(v0, v1) ? 0 : -1;
+	long long stepX0 = -(long long)(v2->y - v1->y) * SUBPIXEL_ONE;
+	long long stepX1 = -(long long)(v0->y - v2->y) * SUBPIXEL_ONE;
+	long long stepX2 = -(long long)(v1->y - v0->y) * SUBPIXEL_ONE;
+	double invArea = 1.0 / (double)area;
+
+	for( int y=minY; y<=maxY; ++y ) {
+		int py = y << SUBPIXEL_BITS;
+		int px = minX << SUBPIXEL_BITS;
+		long long e0 = edgeFunction(v1, v2, px, py);
+		long long e1 = edgeFunction(v2, v0, px, py);
+		long long e2 = edgeFunction(v0, v1, px, py);
+
+		for( int x=minX; x<=maxX; ++x, e0 += stepX0, e1 += stepX1, e2 += stepX2 ) {
+			if( e0 + bias0 < 0 || e1 + bias1 < 0 || e2 + bias2 < 0 )
+				continue;
+
+			float b0 = (float)(e0 * invArea);
+			float b1 = (float)(e1 * invArea);
+			float b2 = (float)(e2 * invArea);
+
+			shadePixel(dev, y*dev->width + x,
+					   b0*v0->rhw + b1*v1->rhw + b2*v2->rhw,
+					   b0*v0->z   + b1*v1->z   + b2*v2->z,
+					   b0*v0->a   + b1*v1->a   + b2*v2->a,
+					   b0*v0->r   + b1*v1->r   + b2*v2->r,
+					   b0*v0->g   + b1*v1->g   + b2*v2->g,
+					   b0*v0->b   + b1*v1->b   + b2*v2->b,
+					   b0*v0->u   + b1*v1->u   + b2*v2->u,
+					   b0*v0->v   + b1*v1->v   + b2*v2->v);
+		}
+	}
+}
+
+// draws triangles of the primitive. Vertex i is vertices[indices[i]] (or vertices[i] if indices is NULL)
+static HRESULT drawTriangles(SOFTDEVICE *dev, D3DPRIMITIVETYPE primitiveType, D3DTLVERTEX *vertices, LPWORD indices, DWORD count) {
+	#define VTX(i) (&vertices[indices ? indices[i] : (i)])
+
+	switch( primitiveType ) {
+		case D3DPT_TRIANGLELIST :
+			for( DWORD i=0; i+2<count; i+=3 )
+				drawTriangle(dev, VTX(i), VTX(i+1), VTX(i+2));
+			break;
+
+		case D3DPT_TRIANGLESTRIP :
+			for( DWORD i=0; i+2<count; ++i ) {
+				if( i & 1 )
+					drawTriangle(dev, VTX(i+1), VTX(i), VTX(i+2));
+				else
+					drawTriangle(dev, VTX(i), VTX(i+1), VTX(i+2));
+			}
+			break;
+
+		case D3DPT_TRIANGLEFAN :
+			for( DWORD i=1; i+1<count; ++i )
+				drawTriangle(dev, VTX(0), VTX(i), VTX(i+1));
+			break;
+
+		default :
+			return SOFT_E_INVALIDPARAMS;
+	}
+	return 0;
+
+	#undef VTX
+}
+
+static HRESULT __stdcall softSetRenderState(struct IDirect3DDevice2 **This, D3DRENDERSTATETYPE state, DWORD value) {
+	SOFTDEVICE *dev = getDevice(This);
+
+	++dev->setRenderStateCount;
+	if( state < 0 || state >= SOFT_STATE_COUNT )
+		return SOFT_E_INVALIDPARAMS;
+
+	dev->renderStates[state] = value;
+	return 0;
+}
+
+static HRESULT __stdcall softDrawPrimitive(struct IDirect3DDevice2 **This, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType,
+										   LPVOID vertices, DWORD vertexCount, DWORD flags)
+{
+	SOFTDEVICE *dev = getDevice(This);
+
+	++dev->drawPrimitiveCount;
+	dev->vertexCount += vertexCount;
+	if( vertexType != D3DVT_TLVERTEX )
+		return SOFT_E_INVALIDPARAMS;
+
+	return drawTriangles(dev, primitiveType, vertices, NULL, vertexCount);
+}
+
+static HRESULT __stdcall softDrawIndexedPrimitive(struct IDirect3DDevice2 **This, D3DPRIMITIVETYPE primitiveType, D3DVERTEXTYPE vertexType,
+												  LPVOID vertices, DWORD vertexCount, LPWORD indices, DWORD indexCount, DWORD flags)
+{
+	SOFTDEVICE *dev = getDevice(This);
+
+	++dev->drawPrimitiveCount;
+	dev->vertexCount += vertexCount;
+	if( vertexType != D3DVT_TLVERTEX )
+		return SOFT_E_INVALIDPARAMS;
+
+	for( DWORD i=0; i<indexCount; ++i ) {
+		if( indices[i] >= vertexCount )
+			return SOFT_E_INVALIDPARAMS;
+	}
+	return drawTriangles(dev, primitiveType, vertices, indices, indexCount);
+}
+
+SOFTDEVICE *createSoftDevice(int width, int height) {
+	SOFTDEVICE *dev = calloc(1, sizeof(SOFTDEVICE));
+	if( dev == NULL )
+		return NULL;
+
+	dev->lpVtbl = &softDeviceInterface;
+	dev->width = width;
+	dev->height = height;
+	if( width > 0 && height > 0 ) {
+		dev->frameBuffer = malloc(sizeof(D3DCOLOR)*width*height);
+		dev->zBuffer = malloc(sizeof(float)*width*height);
+		if( dev->frameBuffer == NULL || dev->zBuffer == NULL ) {
+			destroySoftDevice(dev);
+			return NULL;
+		}
+	}
+
+	// DX5 default render states
+	dev->renderStates[D3DRENDERSTATE_ZENABLE] = FALSE;
+	dev->renderStates[D3DRENDERSTATE_ZWRITEENABLE] = TRUE;
+	dev->renderStates[D3DRENDERSTATE_ZFUNC] = CMP_LESSEQUAL;
+	dev->renderStates[D3DRENDERSTATE_CULLMODE] = CULL_CCW;
+	dev->renderStates[D3DRENDERSTATE_TEXTUREMAPBLEND] = 2; // D3DTBLEND_MODULATE
+
+	clearSoftDevice(dev, RGBA_MAKE(0, 0, 0, 0xFFu), 1.0f);
+	return dev;
+}
+
+void destroySoftDevice(SOFTDEVICE *device) {
+	if( device == NULL )
+		return;
+
+	for( int i=0; i<SOFT_MAX_PAGES; ++i )
+		free(device->pages[i]);
+	free(device->frameBuffer);
+	free(device->zBuffer);
+	free(device);
+}
+
+void clearSoftDevice(SOFTDEVICE *device, D3DCOLOR color, float z) {
+	for( int i=0; i<device->width*device->height; ++i ) {
+		device->frameBuffer[i] = color;
+		device->zBuffer[i] = z;
+	}
+}
+
+DWORD loadSoftTexturePage(SOFTDEVICE *device, const D3DCOLOR *pixels) {
+	for( int i=0; i<SOFT_MAX_PAGES; ++i ) {
+		if( device->pages[i] != NULL )
+			continue;
+
+		device->pages[i] = malloc(sizeof(D3DCOLOR)*SOFT_PAGE_SIZE*SOFT_PAGE_SIZE);
+		if( device->pages[i] == NULL )
+			return 0;
+
+		memcpy(device->pages[i], pixels, sizeof(D3DCOLOR)*SOFT_PAGE_SIZE*SOFT_PAGE_SIZE);
+		return i+1;
+	}
+	return 0;
+}
+
+DWORD getSoftDeviceChecksum(SOFTDEVICE *device) {
+	DWORD hash = 2166136261u;
+
+	for( int i=0; i<device->width*device->height; ++i ) {
+		D3DCOLOR color = device->frameBuffer[i];
+		for( int j=0; j<4; ++j ) {
+			hash ^= (color >> (j*8)) & 0xFF;
+			hash *= 16777619u;
+		}
+	}
+	return hash;
+}
+
+BOOL saveSoftDeviceImage(SOFTDEVICE *device, const char *fileName) {
+	FILE *fp = fopen(fileName, "wb");
+	if( fp == NULL )
+		return FALSE;
+
+	fprintf(fp, "P6\n%d %d\n255\n", device->width, device->height);
+	for( int i=0; i<device->width*device->height; ++i ) {
+		D3DCOLOR color = device->frameBuffer[i];
+		fputc(RGBA_GETRED(color), fp);
+		fputc(RGBA_GETGREEN(color), fp);
+		fputc(RGBA_GETBLUE(color), fp);
+	}
+	return ( fclose(fp) == 0 );
+}
+
+SOFTCONTEXT *createSoftContext(int width, int height) {
+	SOFTCONTEXT *soft = calloc(1, sizeof(SOFTCONTEXT));
+	if( soft == NULL )
+		return NULL;
+
+	soft->device = createSoftDevice(width, height);
+	if( soft->device == NULL ) {
+		free(soft);
+		return NULL;
+	}
+
+	soft->pDevice = (LPDIRECT3DDEVICE2 *)soft->device;
+	soft->screenWidth = width;
+	soft->screenHeight = height;
+	soft->currentTextureHandle = 0;
+	soft->currentAlphaState = FALSE;
+	soft->alphaBlendAvailable = TRUE;
+	soft->textureMargin = 0x80;		// half of 1/256 pixel
+	soft->rhwFactor = 16384.0f;
+	soft->farZ = 20480.0f;
+	soft->farZ_normal = 0.995f;
+	soft->depthZ_normal = 0.0f;
+
+	soft->ctx.pScreenWidth = &soft->screenWidth;
+	soft->ctx.pScreenHeight = &soft->screenHeight;
+	soft->ctx.pDxDevice = &soft->pDevice;
+	soft->ctx.pCurrentTextureHandle = &soft->currentTextureHandle;
+	soft->ctx.pCurrentAlphaState = &soft->currentAlphaState;
+	soft->ctx.pAlphaBlendAvailable = &soft->alphaBlendAvailable;
+	soft->ctx.pTextureMargin = &soft->textureMargin;
+	soft->ctx.pRhwFactor = &soft->rhwFactor;
+	soft->ctx.pFarZ = &soft->farZ;
+	soft->ctx.pFarZ_normal = &soft->farZ_normal;
+	soft->ctx.pDepthZ_normal = &soft->depthZ_normal;
+	return soft;
+}
+
+void destroySoftContext(SOFTCONTEXT *soft) {
+	if( soft == NULL )
+		return;
+
+	destroySoftDevice(soft->device);
+	free(soft);
+}
+
+/** @} */
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Texture pages
+ *
+ * This file implements texture page upload through the game callbacks
+ */
+
+/**
+ * @defgroup TEXTURE_PAGE Texture pages
+ * @brief Texture page upload
+ *
+ * This module contains the bridge to the game texture manager. The DX5
+ * textures are created and loaded by the game, so the DLL-generated
+ * pages are passed to the game callbacks as RGBA pixels, and the game
+ * returns texture handles the pages can be drawn with
+ *
+ * @{
+ */
+
+#include <string.h>
+#include "texturePage.h"
+
+/// Page upload callback of the game
+static TEXPAGEUPLOADFUNC uploadFunc = NULL;
+/// Page release callback of the game
+static TEXPAGERELEASEFUNC releaseFunc = NULL;
+/// Render target callback of the game
+static TEXPAGETARGETFUNC targetFunc = NULL;
+/// Render target creation callback of the game
+static TEXTARGETCREATEFUNC createFunc = NULL;
+
+void setTexturePageCallbacks(TEXPAGEUPLOADFUNC upload, TEXPAGERELEASEFUNC release) {
+	uploadFunc = upload;
+	releaseFunc = release;
+}
+
+void setTexturePageTargetCallback(TEXPAGETARGETFUNC target) {
+	targetFunc = target;
+}
+
+void setTargetCreateCallback(TEXTARGETCREATEFUNC create) {
+	createFunc = create;
+}
+
+BOOL isTexturePageAvailable(void) {
+	return ( uploadFunc != NULL );
+}
+
+DWORD uploadTexturePage(const D3DCOLOR *pixels, DWORD handle) {
+	if( uploadFunc == NULL )
+		return 0;
+	return uploadFunc(pixels, handle);
+}
+
+DWORD createTargetTexture(int *width, int *height) {
+	if( targetFunc == NULL )
+		return 0;
+	if( createFunc != NULL )
+		return createFunc(width, height);
+	if( uploadFunc == NULL )
+		return 0;
+	*width = TEXPAGE_SIZE;
+	*height = TEXPAGE_SIZE;
+	return uploadFunc(NULL, 0);
+}
+
+BOOL setTexturePageTarget(DWORD handle) {
+	if( targetFunc == NULL )
+		return FALSE;
+	return targetFunc(handle);
+}
+
+void releaseTexturePage(DWORD handle) {
+	if( handle != 0 && releaseFunc != NULL )
+		releaseFunc(handle);
+}
+
+// clamps image coordinate, so the edge pixels are repeated outside the image
+static int clampImageCoord(int coord, int size) {
+	if( coord < 0 ) return 0;
+	if( coord >= size ) return size - 1;
+	return coord;
+}
+
+void copyToTexturePage(D3DCOLOR *page, int x, int y, int width, int height,
+					   const D3DCOLOR *pixels, int imageX, int imageY, int imageWidth, int imageHeight, int pitch, int padding)
+{
+	for( int j=-padding; j<height+padding; ++j ) {
+		const D3DCOLOR *src = pixels + clampImageCoord(imageY + j, imageHeight) * pitch;
+		D3DCOLOR *row = page + (y + j) * TEXPAGE_SIZE + x;
+
+		for( int i=-padding; i<0; ++i )
+			row[i] = src[clampImageCoord(imageX + i, imageWidth)];
+		memcpy(row, src + imageX, sizeof(D3DCOLOR) * width);
+		for( int i=width; i<width+padding; ++i )
+			row[i] = src[clampImageCoord(imageX + i, imageWidth)];
+	}
+}
+
+/** @} */
@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Vertex conversion
+ *
+ * This file implements bulk conversion of the 2D vertices to the
+ * transformed and lit vertices
+ */
+
+/**
+ * @defgroup VERTEX_CONVERT Vertex conversion
+ * @brief Bulk vertex conversion kernels
+ *
+ * This module contains scalar, SSE2 and AVX2 kernels converting columns of
+ * the structure of arrays grid to D3DTLVERTEX. The vector kernels merge the source
+ * coordinates and color with the pattern vertex in registers and write
+ * each output vertex with whole aligned stores. The kernels are compiled
+ * only by compilers supporting x86 intrinsics (GCC, Clang, MSVC), and
+ * selected at runtime by the CPU features. Other compilers (i.e. LCC)
+ * use the scalar kernel. Define DISABLE_SIMD to force the scalar kernel
+ *
+ * @{
+ */
+
+#include "vertexConvert.h"
+
+/** @cond Doxygen_Suppress */
+#if !defined(DISABLE_SIMD) && (defined(__i386__) || defined(__x86_64__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_GNUC
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#elif !defined(DISABLE_SIMD) && (defined(_M_IX86) || defined(_M_X64)) && defined(_MSC_VER)
+#define SIMD_MSVC
+#include <intrin.h>
+#include <immintrin.h>
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+/** @endcond */
+
+/// Vertex conversion kernel
+typedef void (*CONVERT_KERNEL)(D3DTLVERTEX *out, const float *x, const float *y, const D3DCOLOR *color, const int *source,
+							   const D3DTLVERTEX *pattern, int patternStride, int count);
+
+static void convertScalar(D3DTLVERTEX *out, const float *x, const float *y, const D3DCOLOR *color, const int *source,
+						  const D3DTLVERTEX *pattern, int patternStride, int count)
+{
+	for( int i=0; i<count; ++i, pattern += patternStride ) {
+		int k = source ? source[i] : i;
+		out[i] = *pattern;
+		out[i].sx = x[k];
+		out[i].sy = y[k];
+		out[i].color = color[k];
+	}
+}
+
+#if defined(SIMD_GNUC) || defined(SIMD_MSVC)
+
+// out vertex is two 16 byte halves: (sx, sy, sz, rhw) and (color, specular, tu, tv)
+TARGET_SSE2 static void convertSSE2(D3DTLVERTEX *out, const float *x, const float *y, const D3DCOLOR *color, const int *source,
+									const D3DTLVERTEX *pattern, int patternStride, int count)
+{
+	const __m128 colorMask = _mm_castsi128_ps(_mm_set_epi32(-1, -1, -1, 0));
+	__m128 patternLo = _mm_loadu_ps(&pattern->sx);
+	__m128 patternHi = _mm_and_ps(_mm_loadu_ps((const float *)&pattern->color), colorMask);
+
+	for( int i=0; i<count; ++i ) {
+		int k = source ? source[i] : i;
+
+		if( patternStride ) {
+			const D3DTLVERTEX *p = &pattern[i*patternStride];
+			patternLo = _mm_loadu_ps(&p->sx);
+			patternHi = _mm_and_ps(_mm_loadu_ps((const float *)&p->color), colorMask);
+		}
+
+		__m128 xy = _mm_unpacklo_ps(_mm_load_ss(&x[k]), _mm_load_ss(&y[k]));
+		__m128 rgba = _mm_castsi128_ps(_mm_cvtsi32_si128((int)color[k]));
+		_mm_store_ps(&out[i].sx, _mm_shuffle_ps(xy, patternLo, _MM_SHUFFLE(3, 2, 1, 0)));
+		_mm_store_ps((float *)&out[i].color, _mm_or_ps(patternHi, rgba));
+	}
+}
+
+// out vertex is one 32 byte vector: source lanes 0, 1, 4 are blended into the pattern
+TARGET_AVX2 static void convertAVX2(D3DTLVERTEX *out, const float *x, const float *y, const D3DCOLOR *color, const int *source,
+									const D3DTLVERTEX *pattern, int patternStride, int count)
+{
+	__m256 patternVec = _mm256_loadu_ps(&pattern->sx);
+
+	for( int i=0; i<count; ++i ) {
+		int k = source ? source[i] : i;
+
+		if( patternStride )
+			patternVec = _mm256_loadu_ps(&pattern[i*patternStride].sx);
+
+		__m128 xy = _mm_unpacklo_ps(_mm_load_ss(&x[k]), _mm_load_ss(&y[k]));
+		__m128 rgba = _mm_castsi128_ps(_mm_cvtsi32_si128((int)color[k]));
+		__m256 srcVec = _mm256_insertf128_ps(_mm256_castps128_ps256(xy), rgba, 1);
+		_mm256_store_ps(&out[i].sx, _mm256_blend_ps(patternVec, srcVec, 0x13));
+	}
+}
+
+// selects the best kernel supported by the CPU and the OS
+static CONVERT_KERNEL selectVectorKernel(const char **name) {
+#if defined(SIMD_GNUC)
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports("avx2") ) {
+		*name = "avx2";
+		return convertAVX2;
+	}
+	if( __builtin_cpu_supports("sse2") ) {
+		*name = "sse2";
+		return convertSSE2;
+	}
+#else // SIMD_GNUC
+	int info[4];
+	__cpuid(info, 1);
+	BOOL hasSSE2 = ( info[3] & (1 << 26) ) != 0;
+	BOOL hasOSXSAVE = ( info[2] & (1 << 27) ) != 0;
+	__cpuid(info, 0);
+	if( info[0] >= 7 && hasOSXSAVE && (_xgetbv(0) & 6) == 6 ) {
+		__cpuidex(info, 7, 0);
+		if( info[1] & (1 << 5) ) {
+			*name = "avx2";
+			return convertAVX2;
+		}
+	}
+	if( hasSSE2 ) {
+		*name = "sse2";
+		return convertSSE2;
+	}
+#endif // SIMD_GNUC
+	return NULL;
+}
+
+#endif // defined(SIMD_GNUC) || defined(SIMD_MSVC)
+
+/// Selected vector kernel (NULL if there is no vector kernel)
+static CONVERT_KERNEL vectorKernel = NULL;
+/// Selected kernel name (NULL if the kernel is not selected yet)
+static const char *kernelName = NULL;
+
+static void selectKernel(void) {
+	kernelName = "scalar";
+#if defined(SIMD_GNUC) || defined(SIMD_MSVC)
+	vectorKernel = selectVectorKernel(&kernelName);
+#endif // defined(SIMD_GNUC) || defined(SIMD_MSVC)
+}
+
+void convertVertices(D3DTLVERTEX *out, const float *x, const float *y, const D3DCOLOR *color, const int *source,
+					 const D3DTLVERTEX *pattern, int patternStride, int count)
+{
+	if( kernelName == NULL )
+		selectKernel();
+
+	if( vectorKernel != NULL && ((size_t)out & (VERTEX_ALIGNMENT-1)) == 0 )
+		vectorKernel(out, x, y, color, source, pattern, patternStride, count);
+	else
+		convertScalar(out, x, y, color, source, pattern, patternStride, count);
+}
+
+const char *getVertexKernelName(void) {
+	if( kernelName == NULL )
+		selectKernel();
+	return kernelName;
+}
+
+/** @} */
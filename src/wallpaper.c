@@ -34,8 +34,10 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include "drawStats.h"
 #include "intMath.h"
 #include "wallpaper.h"
+#include "workerPool.h"
 
 /// Short wave horizontal pattern step
 #define SHORT_WAVE_X_STEP	(0x3000)
@@ -56,10 +58,117 @@
 
 /// Pixel accuracy factor (for more exact integer computations)
 #define PIXEL_ACCURACY	(4)
-/// Animated pattern detail level (Increases the smoothness of the curve)
-#define PATTERN_DETAIL	(2)
 /// Animated chart detail level (Increases the smoothness of the curve)
 #define CHART_DETAIL	(3)
+/// Number of angle integer representations (full period of the sine tables)
+#define PHASE_COUNT	(0x10000)
+/// Number of sines calculated by one intSinCosStrided() call
+#define WAVE_BATCH_SIZE	(256)
+/// Minimum number of grid vertices per worker band (smaller grids are generated inline)
+#define PARALLEL_MIN_VERTICES	(2048)
+/// Maximum animated pattern detail level the adaptive detail may choose (it is lowered for the grid to fit one indexed draw call)
+#define PATTERN_MAX_DETAIL	(8)
+#ifndef PATTERN_TIME_BUDGET
+/// Default CPU time budget of the animated pattern per frame (microseconds). Zero disables adaptive detail
+#define PATTERN_TIME_BUDGET	(1000.0f)
+#endif // PATTERN_TIME_BUDGET
+/// Game frame rate the wave speeds are defined for (frames per second)
+#define WAVE_FRAME_RATE	(30)
+/// Deformation and short wave speed (angle per game frame, minus 3.92 degrees)
+#define SHORT_WAVE_SPEED	(-0x0267)
+/// Long wave speed (angle per game frame, minus 2.81 degrees)
+#define LONG_WAVE_SPEED		(-0x0200)
+/// Maximum time the clock advances by at once (microseconds). Longer pauses do not jump the waves
+#define WAVE_CLOCK_MAX_ELAPSED	(1000000)
+/// Half number of vertical rows of the animated wallpaper
+#define ANIMATED_HALF_ROWS	(3)
+/// Deformation amplitude of the animated wallpaper (percent)
+#define ANIMATED_AMPLITUDE	(10)
+#if defined DEBUG_WP_CHART
+/// Default animated wallpaper style
+#define ANIMATED_STYLE_DEFAULT	(AWS_CHART)
+#elif defined DEBUG_WP_PURERED
+#define ANIMATED_STYLE_DEFAULT	(AWS_PURERED)
+#else
+#define ANIMATED_STYLE_DEFAULT	(AWS_PATTERN)
+#endif
+/// Weight of the new sample in the average cost of the animated pattern
+#define LOD_AVERAGE_WEIGHT	(0.125f)
+/// Detail level is raised only if the predicted cost is less than this part of the budget
+#define LOD_RAISE_MARGIN	(0.7f)
+/// Number of frames measured after the detail is raised or set, before it may be raised again
+#define LOD_SETTLE_FRAMES	(16)
+/// Number of frames measured after the detail is lowered, before it may be raised again
+#define LOD_COOLDOWN_FRAMES	(256)
+
+/// Static pattern mesh cache key
+typedef struct {
+	BOOL isValid;	///< The mesh is built for the values below
+	DRAWCONSTANTS constants;	///< Frame constants the mesh is built with
+	int rowCount;	///< Number of pattern rows
+	TEXTURE txr;	///< Texture rectangle
+} STATICMESHKEY;
+
+/// Animated pattern phase offsets. Vertex phase is the frame phase plus the offset of the vertex
+typedef struct {
+	int countX;	///< Number of grid columns
+	int countY;	///< Number of grid rows
+	int stride;	///< Column stride (elements)
+	int detail;	///< Pattern detail level
+	WORD *shortWave;	///< Short wave (and deform wave) phase offsets. Same layout as the grid arrays
+	WORD *longWave;		///< Long wave phase offsets. Same layout as the grid arrays
+} PHASEFIELD;
+
+/// Pre-scaled sine tables of the animated pattern
+typedef struct {
+	int *deformTable;			///< Deform wave table: intSin(phase)*deformRadius/0x4000
+	signed char *lightTable;	///< Lighting wave table: intSin(phase)*32/0x4000
+	int deformRadius;			///< Radius the deform wave table is scaled by (-1 if the table is not built)
+	BOOL isLightTableReady;		///< Lighting wave table build indicator
+	INTSINVARIANT variant;		///< Sine table variant the tables are built by
+} WAVETABLES;
+
+/// Grid column band job of the animated patterns. Each column is computed from the phases of the first one
+typedef struct {
+	GRID2D *grid;		///< Grid to fill
+	PHASEFIELD *field;	///< Phase offsets (animated pattern only)
+	WAVETABLES *tables;	///< Pre-scaled sine tables (animated pattern only)
+	int baseX;		///< X coordinate of the first column (PIXEL_ACCURACY units)
+	int baseY;		///< Y coordinate of the first row (PIXEL_ACCURACY units)
+	int tileSize;	///< Distance between columns and rows (PIXEL_ACCURACY units)
+	int tileRadius;	///< Deformation radius (PIXEL_ACCURACY units)
+	WORD deformPhase;	///< Deform wave phase of the first vertex
+	WORD shortPhase;	///< Short wave phase of the first vertex
+	WORD longPhase;		///< Long wave phase of the first vertex
+} PATTERNJOB;
+
+/// Static pattern grid column band job
+typedef struct {
+	GRID2D *grid;	///< Grid to fill
+	int width;		///< Screen width (pixels)
+	int height;		///< Screen height (pixels)
+	DIVIDER colDivider;	///< Divider by the number of pattern columns
+	DIVIDER rowDivider;	///< Divider by the number of pattern rows
+} STATICJOB;
+
+/// Adaptive detail controller of the animated pattern
+typedef struct {
+	float budget;		///< CPU time budget per frame (microseconds). Zero disables adaptive detail
+	float averageCost;	///< Average cost of the current detail level (microseconds)
+	int sampleCount;	///< Number of frames drawn with the current detail level
+	int settleCount;	///< Number of frames to measure before the detail may be raised
+} LODCONTROL;
+
+/// Pattern wallpaper state. Nothing else is changed by the draws, so the states are independent
+struct PATTERNSTATE {
+	ANIMSTYLE animatedStyle;	///< Animated wallpaper style
+	int detail;					///< Animated pattern detail level
+	LODCONTROL lodControl;		///< Animated pattern adaptive detail controller
+	PHASEFIELD phaseField;		///< Animated pattern phase offsets
+	WAVETABLES waveTables;		///< Animated pattern wave tables
+	GRIDMESH staticMesh;		///< Static pattern mesh
+	STATICMESHKEY staticMeshKey;	///< Static pattern mesh cache key
+};
 
 // The farther the point from the center of the screen, the darker it is
 static D3DCOLOR centerLighting(int x, int y, int width, int height) { // range is calculated for ( x>=0 && x<=width && y>=0 && y<=height )
@@ -72,7 +181,7 @@ static D3DCOLOR centerLighting(int x, int y, int width, int height) { // range i
 }
 
 // fill far plane of the view by color
-static void fillScreen(TR2CONTEXT *ctx, D3DCOLOR color) {
+static void fillScreen(DRAWCONTEXT *dc, TR2CONTEXT *ctx, D3DCOLOR color) {
 	VERTEX2D vtx[4];
 
 	vtx[0].x = 0;
@@ -91,101 +200,359 @@ static void fillScreen(TR2CONTEXT *ctx, D3DCOLOR color) {
 	vtx[3].y = *ctx->pScreenHeight;
 	vtx[3].color = color;
 
-	renderColoredQuad(ctx, &vtx[0], &vtx[1], &vtx[2], &vtx[3], *ctx->pFarZ);
+	renderColoredQuad(dc, ctx, &vtx[0], &vtx[1], &vtx[2], &vtx[3], *ctx->pFarZ);
 }
 
-void drawStaticPattern(TR2CONTEXT *ctx, TEXTURE *txr, int rowCount) {
-	int colCount = mulDiv(rowCount, *ctx->pScreenWidth, *ctx->pScreenHeight);
+// restarts measurement of the animated pattern cost
+static void resetPatternCost(PATTERNSTATE *pattern, int settleCount) {
+	pattern->lodControl.averageCost = 0.0f;
+	pattern->lodControl.sampleCount = 0;
+	pattern->lodControl.settleCount = settleCount;
+}
+
+// lowers the detail as soon as the average cost exceeds the budget. Raises it only if the cost
+// predicted by the vertex count fits the budget with margin, so the detail does not oscillate
+static void adaptPatternDetail(PATTERNSTATE *pattern, float cost, int maxDetail) {
+	LODCONTROL *lod = &pattern->lodControl;
+
+	if( lod->budget <= 0.0f )
+		return;
+
+	// the first frame of the level rebuilds the phase field and the tables, so it is not measured
+	if( lod->sampleCount++ == 0 )
+		return;
+	lod->averageCost = ( lod->sampleCount > 2 ) ? lod->averageCost + (cost - lod->averageCost) * LOD_AVERAGE_WEIGHT : cost;
+
+	if( lod->averageCost > lod->budget && pattern->detail > 1 ) {
+		--pattern->detail;
+		resetPatternCost(pattern, LOD_COOLDOWN_FRAMES);
+		return;
+	}
+
+	if( lod->sampleCount >= lod->settleCount && pattern->detail < maxDetail ) {
+		float ratio = (float)(pattern->detail + 1) / (float)pattern->detail;
+		if( lod->averageCost * ratio * ratio < lod->budget * LOD_RAISE_MARGIN ) {
+			++pattern->detail;
+			resetPatternCost(pattern, LOD_SETTLE_FRAMES);
+		}
+	}
+}
+
+PATTERNSTATE *createPatternState(void) {
+	PATTERNSTATE *pattern = calloc(1, sizeof(PATTERNSTATE));
+
+	if( pattern == NULL )
+		return NULL;
+	countAllocation(sizeof(PATTERNSTATE));
+
+	pattern->animatedStyle = ANIMATED_STYLE_DEFAULT;
+	pattern->detail = PATTERN_DETAIL;
+	pattern->lodControl.budget = PATTERN_TIME_BUDGET;
+	pattern->lodControl.settleCount = LOD_SETTLE_FRAMES;
+	pattern->waveTables.deformRadius = -1;
+	return pattern;
+}
+
+void freePatternState(PATTERNSTATE *pattern) {
+	if( pattern == NULL )
+		return;
+
+	free(pattern->phaseField.shortWave);
+	free(pattern->waveTables.deformTable);
+	freeGridMesh(&pattern->staticMesh);
+	free(pattern);
+}
+
+void setPatternDetail(PATTERNSTATE *pattern, int detail) {
+	pattern->detail = ( detail > 0 ) ? detail : PATTERN_DETAIL;
+	resetPatternCost(pattern, LOD_SETTLE_FRAMES);
+}
+
+void setPatternTimeBudget(PATTERNSTATE *pattern, float budget) {
+	pattern->lodControl.budget = ( budget >= 0.0f ) ? budget : PATTERN_TIME_BUDGET;
+	resetPatternCost(pattern, LOD_SETTLE_FRAMES);
+}
+
+int getPatternDetail(PATTERNSTATE *pattern) {
+	return pattern->detail;
+}
+
+// checks if the cached static pattern mesh is built for these parameters. The mesh is keyed on the
+// constant values, so the generation changes by the other draws of the context do not rebuild it
+static BOOL isStaticMeshValid(STATICMESHKEY *key, DRAWCONTEXT *dc, TEXTURE *txr, int rowCount) {
+	return ( key->isValid
+		&& isSameDrawConstants(&key->constants, getDrawConstants(dc))
+		&& key->rowCount == rowCount
+		&& !memcmp(&key->txr, txr, sizeof(TEXTURE)) );
+}
+
+// gets minimum band size of the grid generation (columns)
+static int getMinBandSize(GRID2D *grid) {
+	return PARALLEL_MIN_VERTICES / grid->countY + 1;
+}
+
+static void buildStaticColumns(void *param, int begin, int end) {
+	STATICJOB *job = (STATICJOB *)param;
+	GRID2D *grid = job->grid;
+
+	for( int i=begin; i<end; ++i ) {
+		float *x = &grid->x[i*grid->stride];
+		float *y = &grid->y[i*grid->stride];
+		D3DCOLOR *color = &grid->color[i*grid->stride];
+		float columnX = (float)mulDivBy(job->width, i, &job->colDivider);
+
+		for( int j=0; j<grid->countY; ++j )
+			x[j] = columnX;
+		for( int j=0; j<grid->countY; ++j )
+			y[j] = (float)mulDivBy(job->height, j, &job->rowDivider);
+		for( int j=0; j<grid->countY; ++j )
+			color[j] = centerLighting(x[j], y[j], job->width, job->height);
+	}
+}
+
+void drawStaticPattern(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int rowCount) {
+	STATICMESHKEY *key = &pattern->staticMeshKey;
+	GRID2D grid;
+	int width = *ctx->pScreenWidth;
+	int height = *ctx->pScreenHeight;
+	int colCount = mulDiv(rowCount, width, height);
 	int countY = rowCount+1;
 	int countX = colCount+1;
-	VERTEX2D *vertices = malloc(sizeof(VERTEX2D)*countX*countY);
 
-	for( int i=0; i<countX; ++i ) {
-		for( int j=0; j<countY; ++j ) {
-			VERTEX2D *vtx = &vertices[i*countY+j];
-			vtx->x = (float)mulDiv(*ctx->pScreenWidth,  i, colCount);
-			vtx->y = (float)mulDiv(*ctx->pScreenHeight, j, rowCount);
-			vtx->color = centerLighting(vtx->x, vtx->y, *ctx->pScreenWidth, *ctx->pScreenHeight);
+	// the pattern never changes, so the steady state frames only submit the cached mesh
+	if( isStaticMeshValid(key, dc, txr, rowCount) ) {
+		renderGridMesh(dc, ctx, &pattern->staticMesh);
+		return;
+	}
+	key->isValid = FALSE;
+
+	if( !allocGrid(dc, &grid, countX, countY) )
+		return;
+
+	STATICJOB job = {&grid, width, height};
+	initDivider(&job.colDivider, colCount);
+	initDivider(&job.rowDivider, rowCount);
+	runParallel(buildStaticColumns, &job, countX, getMinBandSize(&grid));
+
+	if( !buildTexturedFarMesh(dc, &pattern->staticMesh, &grid, txr, 1) ) {
+		renderTexturedFarGrid(dc, ctx, &grid, txr, 1);
+		return;
+	}
+
+	key->isValid = TRUE;
+	key->constants = *getDrawConstants(dc);
+	key->rowCount = rowCount;
+	key->txr = *txr;
+	renderGridMesh(dc, ctx, &pattern->staticMesh);
+}
+
+// rebuilds phase offsets only if the grid dimensions are changed
+static PHASEFIELD *getPhaseField(PATTERNSTATE *pattern, GRID2D *grid, int detail) {
+	PHASEFIELD *field = &pattern->phaseField;
+
+	if( field->shortWave == NULL || field->countX != grid->countX || field->countY != grid->countY
+		|| field->stride != grid->stride || field->detail != detail )
+	{
+		size_t size = sizeof(WORD)*grid->countX*grid->stride;
+
+		free(field->shortWave);
+		field->shortWave = malloc(size*2);
+		countAllocation(size*2);
+		if( field->shortWave == NULL )
+			return NULL;
+
+		field->longWave = field->shortWave + grid->countX*grid->stride;
+		field->countX = grid->countX;
+		field->countY = grid->countY;
+		field->stride = grid->stride;
+		field->detail = detail;
+
+		for( int i=0; i<grid->countX; ++i ) {
+			WORD *shortWave = &field->shortWave[i*grid->stride];
+			WORD *longWave = &field->longWave[i*grid->stride];
+
+			for( int j=0; j<grid->countY; ++j ) {
+				shortWave[j] = SHORT_WAVE_X_STEP / detail * i + SHORT_WAVE_Y_STEP / detail * j;
+				longWave[j] = LONG_WAVE_X_STEP / detail * i + LONG_WAVE_Y_STEP / detail * j;
+			}
 		}
 	}
+	return field;
+}
+
+// rebuilds the pre-scaled sine tables if the deform radius is changed
+static WAVETABLES *prepareWaveTables(PATTERNSTATE *pattern, int radius) {
+	WAVETABLES *tables = &pattern->waveTables;
+	short sines[WAVE_BATCH_SIZE];
 
-	for( int i=0; i<colCount; ++i ) {
-		for( int j=0; j<rowCount; ++j ) {
-			VERTEX2D *vtx0 = &vertices[(i+0)*countY+(j+0)];
-			VERTEX2D *vtx1 = &vertices[(i+1)*countY+(j+0)];
-			VERTEX2D *vtx2 = &vertices[(i+0)*countY+(j+1)];
-			VERTEX2D *vtx3 = &vertices[(i+1)*countY+(j+1)];
-			renderTexturedFarQuad(ctx, vtx0, vtx1, vtx2, vtx3, txr);
+	if( tables->deformTable == NULL ) {
+		size_t size = (sizeof(int) + sizeof(signed char)) * PHASE_COUNT;
+
+		tables->deformTable = malloc(size);
+		countAllocation(size);
+		if( tables->deformTable == NULL )
+			return NULL;
+		tables->lightTable = (signed char *)(tables->deformTable + PHASE_COUNT);
+	}
+	if( tables->variant != getIntSinVariant() ) {
+		tables->variant = getIntSinVariant();
+		tables->isLightTableReady = FALSE;
+		tables->deformRadius = -1;
+	}
+	if( !tables->isLightTableReady ) {
+		for( int i=0; i<PHASE_COUNT; i+=WAVE_BATCH_SIZE ) {
+			intSinCosStrided(i, 1, sines, NULL, WAVE_BATCH_SIZE);
+			for( int k=0; k<WAVE_BATCH_SIZE; ++k )
+				tables->lightTable[i+k] = sines[k]*32/0x4000;
 		}
+		tables->isLightTableReady = TRUE;
 	}
-	free(vertices);
+	if( tables->deformRadius != radius ) {
+		for( int i=0; i<PHASE_COUNT; i+=WAVE_BATCH_SIZE ) {
+			intSinCosStrided(i, 1, sines, NULL, WAVE_BATCH_SIZE);
+			for( int k=0; k<WAVE_BATCH_SIZE; ++k )
+				tables->deformTable[i+k] = sines[k]*radius/0x4000;
+		}
+		tables->deformRadius = radius;
+	}
+	return tables;
 }
 
-void drawAnimatedPattern(TR2CONTEXT *ctx, TEXTURE *txr, int halfRowCount, unsigned char amplitude,
-						 short deformWavePhase, short shortWavePhase, short longWavePhase)
+// each attribute is one add and one table lookup per vertex. The light never leaves 64..192, so no clamping needed
+static void buildPatternColumns(void *param, int begin, int end) {
+	PATTERNJOB *job = (PATTERNJOB *)param;
+	GRID2D *grid = job->grid;
+	const int *deformTable = job->tables->deformTable;
+	const signed char *lightTable = job->tables->lightTable;
+	// cosine is the sine shifted by 90 degrees
+	WORD deformPhaseX = job->deformPhase + 0x4000;
+	WORD deformPhaseY = job->deformPhase;
+
+	for( int i=begin; i<end; ++i ) {
+		float *x = &grid->x[i*grid->stride];
+		float *y = &grid->y[i*grid->stride];
+		D3DCOLOR *color = &grid->color[i*grid->stride];
+		const WORD *shortWave = &job->field->shortWave[i*grid->stride];
+		const WORD *longWave = &job->field->longWave[i*grid->stride];
+		int columnX = job->baseX + job->tileSize*i;
+
+		for( int j=0; j<grid->countY; ++j )
+			x[j] = ((float)(columnX + deformTable[(WORD)(deformPhaseX + shortWave[j])])) / PIXEL_ACCURACY;
+		for( int j=0; j<grid->countY; ++j )
+			y[j] = ((float)(job->baseY + job->tileSize*j + deformTable[(WORD)(deformPhaseY + shortWave[j])])) / PIXEL_ACCURACY;
+		for( int j=0; j<grid->countY; ++j ) {
+			int light = 128 + lightTable[(WORD)(job->shortPhase + shortWave[j])] + lightTable[(WORD)(job->longPhase + longWave[j])];
+			color[j] = RGBA_MAKE(light, light, light, 0xFFu);
+		}
+	}
+}
+
+// gets the largest detail level the adaptive detail may choose. Larger grids are drawn quad by quad,
+// so the cost of the next level would be much more than the vertex count predicts
+static int getMaxPatternDetail(TR2CONTEXT *ctx, int halfRowCount) {
+	int halfColCount = mulDiv(halfRowCount, *ctx->pScreenWidth*3, *ctx->pScreenHeight*4)+1;
+	int detail = PATTERN_MAX_DETAIL;
+
+	while( detail > 1 && !isTexturedGridIndexed(halfColCount*detail*2+1, halfRowCount*detail*2+1, detail) )
+		--detail;
+	return detail;
+}
+
+static void renderAnimatedPattern(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int halfRowCount,
+								  unsigned char amplitude, int detail,
+								  short deformWavePhase, short shortWavePhase, short longWavePhase)
 {
+	GRID2D grid;
 	int halfColCount = mulDiv(halfRowCount, *ctx->pScreenWidth*3, *ctx->pScreenHeight*4)+1;
 
-	halfRowCount *= PATTERN_DETAIL;
-	halfColCount *= PATTERN_DETAIL;
+	halfRowCount *= detail;
+	halfColCount *= detail;
 
 	int countY = halfRowCount*2+1;
 	int countX = halfColCount*2+1;
 	int tileSize = mulDiv(*ctx->pScreenHeight, 2*PIXEL_ACCURACY, 3*halfRowCount);
-	int tileRadius = mulDiv(tileSize, amplitude*PATTERN_DETAIL, 100);
+	int tileRadius = mulDiv(tileSize, amplitude*detail, 100);
 	int baseY = *ctx->pScreenHeight*PIXEL_ACCURACY/2 - halfRowCount*tileSize;
 	int baseX = *ctx->pScreenWidth*PIXEL_ACCURACY/2  - halfColCount*tileSize;
-	VERTEX2D *vertices = malloc(sizeof(VERTEX2D)*countX*countY);
-	TEXTURE subTxr;
 
-	deformWavePhase += SHORT_WAVE_X_OFFSET;
-	shortWavePhase  += SHORT_WAVE_X_OFFSET;
-	longWavePhase   += LONG_WAVE_X_OFFSET;
+	if( !allocGrid(dc, &grid, countX, countY) )
+		return;
+
+	PHASEFIELD *field = getPhaseField(pattern, &grid, detail);
+	if( field == NULL )
+		return;
+
+	PATTERNJOB job = {0};
+	job.grid = &grid;
+	job.field = field;
+	job.baseX = baseX;
+	job.baseY = baseY;
+	job.tileSize = tileSize;
+	job.tileRadius = tileRadius;
+	job.deformPhase = deformWavePhase + SHORT_WAVE_X_OFFSET + SHORT_WAVE_Y_OFFSET;
+	job.shortPhase = shortWavePhase + SHORT_WAVE_X_OFFSET + SHORT_WAVE_Y_OFFSET;
+	job.longPhase = longWavePhase + LONG_WAVE_X_OFFSET + LONG_WAVE_Y_OFFSET;
+
+	job.tables = prepareWaveTables(pattern, tileRadius);
+	if( job.tables == NULL )
+		return;
+	runParallel(buildPatternColumns, &job, countX, getMinBandSize(&grid));
+	renderTexturedFarGrid(dc, ctx, &grid, txr, detail);
+}
 
-	for( int i=0; i<countX; ++i ) {
-		short deformWaveRowPhase = deformWavePhase + SHORT_WAVE_Y_OFFSET;
-		short shortWaveRowPhase  = shortWavePhase  + SHORT_WAVE_Y_OFFSET;
-		short longWaveRowPhase   = longWavePhase   + LONG_WAVE_Y_OFFSET;
-
-		for( int j=0; j<countY; ++j ) {
-			VERTEX2D *vtx = &vertices[i*countY+j];
-			int shortWave = intSin(shortWaveRowPhase)*32/0x4000;
-			int longWave = intSin(longWaveRowPhase)*32/0x4000;
-
-			vtx->color = grayToRGBA(128+shortWave+longWave, 0);
-			vtx->y = ((float)(baseY + tileSize*j + intSin(deformWaveRowPhase)*tileRadius/0x4000)) / PIXEL_ACCURACY;
-			vtx->x = ((float)(baseX + tileSize*i + intCos(deformWaveRowPhase)*tileRadius/0x4000)) / PIXEL_ACCURACY;
-
-			deformWaveRowPhase += SHORT_WAVE_Y_STEP / PATTERN_DETAIL;
-			shortWaveRowPhase  += SHORT_WAVE_Y_STEP / PATTERN_DETAIL;
-			longWaveRowPhase   += LONG_WAVE_Y_STEP  / PATTERN_DETAIL;
-		}
-		deformWavePhase += SHORT_WAVE_X_STEP / PATTERN_DETAIL;
-		shortWavePhase  += SHORT_WAVE_X_STEP / PATTERN_DETAIL;
-		longWavePhase   += LONG_WAVE_X_STEP  / PATTERN_DETAIL;
+void drawAnimatedPattern(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int halfRowCount, unsigned char amplitude,
+						 short deformWavePhase, short shortWavePhase, short longWavePhase)
+{
+	long long startTime = getStatsTimer();
+	int maxDetail = getMaxPatternDetail(ctx, halfRowCount);
+
+	if( pattern->lodControl.budget > 0.0f && pattern->detail > maxDetail ) {
+		pattern->detail = maxDetail;
+		resetPatternCost(pattern, LOD_SETTLE_FRAMES);
 	}
 
-	subTxr.handle = txr->handle;
-	subTxr.width  = txr->width  / PATTERN_DETAIL;
-	subTxr.height = txr->height / PATTERN_DETAIL;
-
-	for( int i=0; i<halfColCount*2; ++i ) {
-		for( int j=0; j<halfRowCount*2; ++j ) {
-			VERTEX2D *vtx0 = &vertices[(i+0)*countY+(j+0)];
-			VERTEX2D *vtx1 = &vertices[(i+1)*countY+(j+0)];
-			VERTEX2D *vtx2 = &vertices[(i+0)*countY+(j+1)];
-			VERTEX2D *vtx3 = &vertices[(i+1)*countY+(j+1)];
-			subTxr.x = txr->x + (i%PATTERN_DETAIL)*subTxr.width;
-			subTxr.y = txr->y + (j%PATTERN_DETAIL)*subTxr.height;
-			renderTexturedFarQuad(ctx, vtx0, vtx1, vtx2, vtx3, &subTxr);
+	// the grid and the texture tiles are subdivided by the same detail level, so the texture stays consistent
+	renderAnimatedPattern(pattern, dc, ctx, txr, halfRowCount, amplitude, pattern->detail, deformWavePhase, shortWavePhase, longWavePhase);
+	// the quads left in the batch are sent too, so the cost is of the whole draw
+	flushDrawBatch(dc, ctx);
+	adaptPatternDetail(pattern, getStatsElapsed(startTime), maxDetail);
+}
+
+static void buildPureRedColumns(void *param, int begin, int end) {
+	PATTERNJOB *job = (PATTERNJOB *)param;
+	GRID2D *grid = job->grid;
+
+	for( int i=begin; i<end; ++i ) {
+		float *x = &grid->x[i*grid->stride];
+		float *y = &grid->y[i*grid->stride];
+		D3DCOLOR *color = &grid->color[i*grid->stride];
+		float columnX = ((float)(job->baseX + job->tileSize*i)) / PIXEL_ACCURACY;
+		WORD shortPhase = job->shortPhase + SHORT_WAVE_X_STEP / CHART_DETAIL * i;
+		WORD longPhase = job->longPhase + LONG_WAVE_X_STEP / CHART_DETAIL * i;
+
+		for( int j=0; j<grid->countY; ++j )
+			x[j] = columnX;
+		for( int j=0; j<grid->countY; ++j )
+			y[j] = ((float)(job->baseY + job->tileSize*j)) / PIXEL_ACCURACY;
+		for( int j=0; j<grid->countY; j+=WAVE_BATCH_SIZE ) {
+			short shortSines[WAVE_BATCH_SIZE], longSines[WAVE_BATCH_SIZE];
+			int batch = ( grid->countY-j < WAVE_BATCH_SIZE ) ? grid->countY-j : WAVE_BATCH_SIZE;
+			intSinCosStrided(shortPhase + SHORT_WAVE_Y_STEP / CHART_DETAIL * j, SHORT_WAVE_Y_STEP / CHART_DETAIL, shortSines, NULL, batch);
+			intSinCosStrided(longPhase  + LONG_WAVE_Y_STEP  / CHART_DETAIL * j, LONG_WAVE_Y_STEP  / CHART_DETAIL, longSines,  NULL, batch);
+			for( int k=0; k<batch; ++k ) {
+				int light = 128;
+				light += shortSines[k]*32/0x4000;
+				light += longSines[k]*32/0x4000;
+				color[j+k] = RGBA_MAKE(light, 0, 0, 0xFFu);
+			}
 		}
 	}
-	free(vertices);
 }
 
-void drawAnimatedPureRed(TR2CONTEXT *ctx, int halfRowCount,
+void drawAnimatedPureRed(DRAWCONTEXT *dc, TR2CONTEXT *ctx, int halfRowCount,
 						 short shortWavePhase, short longWavePhase)
 {
+	GRID2D grid;
 	int halfColCount = mulDiv(halfRowCount, *ctx->pScreenWidth*3, *ctx->pScreenHeight*4)+1;
 
 	halfRowCount *= CHART_DETAIL;
@@ -196,98 +563,155 @@ void drawAnimatedPureRed(TR2CONTEXT *ctx, int halfRowCount,
 	int tileSize = mulDiv(*ctx->pScreenHeight, 2*PIXEL_ACCURACY, 3*halfRowCount);
 	int baseY = *ctx->pScreenHeight*PIXEL_ACCURACY/2 - halfRowCount*tileSize;
 	int baseX = *ctx->pScreenWidth*PIXEL_ACCURACY/2  - halfColCount*tileSize;
-	VERTEX2D *vertices = malloc(sizeof(VERTEX2D)*countX*countY);
 
-	shortWavePhase += SHORT_WAVE_X_OFFSET;
-	longWavePhase  += LONG_WAVE_X_OFFSET;
+	if( !allocGrid(dc, &grid, countX, countY) )
+		return;
 
-	for( int i=0; i<countX; ++i ) {
-		short shortWaveRowPhase = shortWavePhase + SHORT_WAVE_Y_OFFSET;
-		short longWaveRowPhase  = longWavePhase  + LONG_WAVE_Y_OFFSET;
-
-		for( int j=0; j<countY; ++j ) {
-			VERTEX2D *vtx = &vertices[i*countY+j];
-			int light = 128;
-			light += intSin(shortWaveRowPhase)*32/0x4000;
-			light += intSin(longWaveRowPhase)*32/0x4000;
-
-			vtx->color = RGBA_MAKE(light, 0, 0, 0xFFu);
-			vtx->y = ((float)(baseY + tileSize*j)) / PIXEL_ACCURACY;
-			vtx->x = ((float)(baseX + tileSize*i)) / PIXEL_ACCURACY;
-
-			shortWaveRowPhase += SHORT_WAVE_Y_STEP / CHART_DETAIL;
-			longWaveRowPhase  += LONG_WAVE_Y_STEP  / CHART_DETAIL;
-		}
-		shortWavePhase += SHORT_WAVE_X_STEP / CHART_DETAIL;
-		longWavePhase  += LONG_WAVE_X_STEP  / CHART_DETAIL;
-	}
+	PATTERNJOB job = {0};
+	job.grid = &grid;
+	job.baseX = baseX;
+	job.baseY = baseY;
+	job.tileSize = tileSize;
+	job.shortPhase = shortWavePhase + SHORT_WAVE_X_OFFSET + SHORT_WAVE_Y_OFFSET;
+	job.longPhase = longWavePhase + LONG_WAVE_X_OFFSET + LONG_WAVE_Y_OFFSET;
+	runParallel(buildPureRedColumns, &job, countX, getMinBandSize(&grid));
 
-	for( int i=0; i<halfColCount*2; ++i ) {
-		for( int j=0; j<halfRowCount*2; ++j ) {
-			VERTEX2D *vtx0 = &vertices[(i+0)*countY+(j+0)];
-			VERTEX2D *vtx1 = &vertices[(i+1)*countY+(j+0)];
-			VERTEX2D *vtx2 = &vertices[(i+0)*countY+(j+1)];
-			VERTEX2D *vtx3 = &vertices[(i+1)*countY+(j+1)];
-			renderColoredQuad(ctx, vtx0, vtx1, vtx2, vtx3, *ctx->pFarZ);
-		}
-	}
-	free(vertices);
+	renderColoredGrid(dc, ctx, &grid, *ctx->pFarZ);
 }
 
-void drawAnimatedChart(TR2CONTEXT *ctx, int halfRowCount,
+void drawAnimatedChart(DRAWCONTEXT *dc, TR2CONTEXT *ctx, int halfRowCount,
 					   short shortWavePhase, short longWavePhase)
 {
+	GRID2D grid;
 	int halfColCount = mulDiv(halfRowCount, *ctx->pScreenWidth*3, *ctx->pScreenHeight*4)+1;
 	int tileSize = mulDiv(*ctx->pScreenHeight, 2*PIXEL_ACCURACY, 3*halfRowCount);
 	int baseX = *ctx->pScreenWidth*PIXEL_ACCURACY/2 - halfColCount*tileSize;
+	VERTEX2D vtx[4];
 
 	halfColCount *= CHART_DETAIL;
 
+	// three charts, each one is the grid row pair: the curve (row j*2) and the baseline (row j*2+1)
 	int countX = halfColCount*2+1;
-	VERTEX2D *vertices = malloc(sizeof(VERTEX2D)*countX*6);
+	if( !allocGrid(dc, &grid, countX, 6) )
+		return;
+
+	fillScreen(dc, ctx, 0xFF000000); // set black screen background
+
+	shortWavePhase += SHORT_WAVE_Y_OFFSET + SHORT_WAVE_Y_STEP + SHORT_WAVE_X_OFFSET;
+	longWavePhase  += LONG_WAVE_Y_OFFSET  + LONG_WAVE_Y_STEP  + LONG_WAVE_X_OFFSET;
 
-	fillScreen(ctx, 0xFF000000); // set black screen background
+	for( int i=0; i<countX; ++i ) {
+		float *x = &grid.x[i*grid.stride];
+		float columnX = ((float)(baseX + tileSize*i/3)) / PIXEL_ACCURACY;
 
-	shortWavePhase += SHORT_WAVE_Y_OFFSET + SHORT_WAVE_Y_STEP;
-	longWavePhase  += LONG_WAVE_Y_OFFSET  + LONG_WAVE_Y_STEP;
+		for( int j=0; j<6; ++j )
+			x[j] = columnX;
+	}
 
 	for( int j=0; j<3; ++j ) {
-		short shortWaveRowPhase = shortWavePhase + SHORT_WAVE_X_OFFSET;
-		short longWaveRowPhase  = longWavePhase  + LONG_WAVE_X_OFFSET;
+		float baseline = (float)(*ctx->pScreenHeight*(j + 1))/3;
+		short shortSines[WAVE_BATCH_SIZE], longSines[WAVE_BATCH_SIZE];
 
 		for( int i=0; i<countX; ++i ) {
-			VERTEX2D *vtx0 = &vertices[j*countX*2 + i*2+0];
-			VERTEX2D *vtx1 = &vertices[j*countX*2 + i*2+1];
+			int k = i*grid.stride + j*2;
+			int m = i % WAVE_BATCH_SIZE;
+			if( m == 0 ) {
+				int batch = ( countX-i < WAVE_BATCH_SIZE ) ? countX-i : WAVE_BATCH_SIZE;
+				intSinCosStrided(shortWavePhase + SHORT_WAVE_X_STEP / CHART_DETAIL * i, SHORT_WAVE_X_STEP / CHART_DETAIL, shortSines, NULL, batch);
+				intSinCosStrided(longWavePhase  + LONG_WAVE_X_STEP  / CHART_DETAIL * i, LONG_WAVE_X_STEP  / CHART_DETAIL, longSines,  NULL, batch);
+			}
 			int light = 128;
-			light += intSin(shortWaveRowPhase)*32/0x4000;
-			light += intSin(longWaveRowPhase)*32/0x4000;
-
-			vtx0->x = ((float)(baseX + tileSize*i/3)) / PIXEL_ACCURACY;
-			vtx1->x = ((float)(baseX + tileSize*i/3)) / PIXEL_ACCURACY;
-
-			vtx1->y = (float)(*ctx->pScreenHeight*(j + 1))/3;
-			vtx0->y = vtx1->y - (float)(*ctx->pScreenHeight*(light-64)/128)/3;
+			light += shortSines[m]*32/0x4000;
+			light += longSines[m]*32/0x4000;
 
-			vtx0->color = RGBA_MAKE(light, 0, 0, 0xFFu);
-			vtx1->color = RGBA_MAKE(light, 0, 0, 0xFFu);
-
-			shortWaveRowPhase += SHORT_WAVE_X_STEP / CHART_DETAIL;
-			longWaveRowPhase  += LONG_WAVE_X_STEP  / CHART_DETAIL;
+			grid.y[k+1] = baseline;
+			grid.y[k+0] = baseline - (float)(*ctx->pScreenHeight*(light-64)/128)/3;
+			grid.color[k+0] = RGBA_MAKE(light, 0, 0, 0xFFu);
+			grid.color[k+1] = RGBA_MAKE(light, 0, 0, 0xFFu);
 		}
 		shortWavePhase += SHORT_WAVE_Y_STEP * (halfRowCount-1);
 		longWavePhase  += LONG_WAVE_Y_STEP  * (halfRowCount-1);
 	}
 
 	for( int j=0; j<3; ++j ) {
-		for( int i=0; i<halfColCount*2; ++i ) {
-			VERTEX2D *vtx0 = &vertices[j*countX*2 + (i+0)*2+0];
-			VERTEX2D *vtx1 = &vertices[j*countX*2 + (i+1)*2+0];
-			VERTEX2D *vtx2 = &vertices[j*countX*2 + (i+0)*2+1];
-			VERTEX2D *vtx3 = &vertices[j*countX*2 + (i+1)*2+1];
-			renderColoredQuad(ctx, vtx0, vtx1, vtx2, vtx3, *ctx->pFarZ - 32);
+		for( int i=0; i<countX-1; ++i ) {
+			getGridVertex(&grid, i+0, j*2+0, &vtx[0]);
+			getGridVertex(&grid, i+1, j*2+0, &vtx[1]);
+			getGridVertex(&grid, i+0, j*2+1, &vtx[2]);
+			getGridVertex(&grid, i+1, j*2+1, &vtx[3]);
+			renderColoredQuad(dc, ctx, &vtx[0], &vtx[1], &vtx[2], &vtx[3], *ctx->pFarZ - 32);
 		}
 	}
-	free(vertices);
+}
+
+void setAnimatedStyle(PATTERNSTATE *pattern, ANIMSTYLE style) {
+	pattern->animatedStyle = ( style >= 0 && style < AWS_COUNT ) ? style : ANIMATED_STYLE_DEFAULT;
+}
+
+void drawAnimatedWallpaper(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int halfRowCount, unsigned char amplitude,
+						   short deformWavePhase, short shortWavePhase, short longWavePhase)
+{
+	switch( pattern->animatedStyle ) {
+		case AWS_PURERED :
+			drawAnimatedPureRed(dc, ctx, halfRowCount, shortWavePhase, longWavePhase);
+			break;
+		case AWS_CHART :
+			drawAnimatedChart(dc, ctx, halfRowCount, shortWavePhase, longWavePhase);
+			break;
+		default :
+			drawAnimatedPattern(pattern, dc, ctx, txr, halfRowCount, amplitude, deformWavePhase, shortWavePhase, longWavePhase);
+			break;
+	}
+}
+
+// advances the wave phases by the elapsed game frames (16.16 fixed point)
+static void advanceWavePhases(WAVECLOCK *clock, DWORD frames) {
+	clock->deformWavePhase += (DWORD)SHORT_WAVE_SPEED * frames;
+	clock->shortWavePhase  += (DWORD)SHORT_WAVE_SPEED * frames;
+	clock->longWavePhase   += (DWORD)LONG_WAVE_SPEED  * frames;
+}
+
+void resetWaveClock(WAVECLOCK *clock) {
+	static const WAVECLOCK initialClock = WAVE_CLOCK_INITIALIZER;
+	*clock = initialClock;
+}
+
+void advanceWaveClockFrame(WAVECLOCK *clock, int frameSpeed) {
+	if( frameSpeed == 0 )
+		return;
+
+	// the remainder is in the units of the last framerate factor
+	if( frameSpeed != clock->frameSpeed ) {
+		clock->frameSpeed = frameSpeed;
+		clock->frameRemainder = 0;
+	}
+	int frames = 0x10000 + clock->frameRemainder;
+	clock->frameRemainder = frames % frameSpeed;
+	advanceWavePhases(clock, (DWORD)(frames / frameSpeed));
+}
+
+void advanceWaveClockTime(WAVECLOCK *clock, long long timestamp) {
+	long long elapsed = timestamp - clock->lastTime;
+
+	if( !clock->isTimeValid || elapsed < 0 ) {
+		clock->lastTime = timestamp;
+		clock->remainder = 0;
+		clock->isTimeValid = TRUE;
+		return;
+	}
+	clock->lastTime = timestamp;
+	if( elapsed > WAVE_CLOCK_MAX_ELAPSED )
+		elapsed = WAVE_CLOCK_MAX_ELAPSED;
+
+	// the division remainder is carried to the next advance, so no time is lost
+	long long frames = elapsed * WAVE_FRAME_RATE * 0x10000 + clock->remainder;
+	clock->remainder = frames % 1000000;
+	advanceWavePhases(clock, (DWORD)(frames / 1000000));
+}
+
+void drawAnimatedWallpaperAt(PATTERNSTATE *pattern, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, WAVECLOCK *clock) {
+	drawAnimatedWallpaper(pattern, dc, ctx, txr, ANIMATED_HALF_ROWS, ANIMATED_AMPLITUDE,
+						  clock->deformWavePhase >> 16, clock->shortWavePhase >> 16, clock->longWavePhase >> 16);
 }
 
 /** @} */
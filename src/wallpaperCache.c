@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * @file
+ * @brief Wallpaper cache
+ *
+ * This file implements render to texture cache of the wallpaper
+ */
+
+/**
+ * @defgroup WALLPAPER_CACHE Wallpaper cache
+ * @brief Wallpaper render to texture cache
+ *
+ * This module contains the cache of the composed wallpaper for low-end
+ * devices. The patterns are rendered once to the screen sized render
+ * target through the game callbacks, with the context copy of the target
+ * size, and the later frames draw just one quad. If the game creates the
+ * texture page targets only, the wallpaper is rendered at the page size.
+ * The bitmap image is not cached: its tiles already cost one quad each.
+ * Each wallpaper instance has its own cache target, and the global
+ * invalidation reaches all of them by the generation counter
+ *
+ * @{
+ */
+
+#include <stdlib.h>
+#include "drawStats.h"
+#include "sharedLock.h"
+#include "texturePage.h"
+#include "wallpaperCache.h"
+
+/// Wallpaper cache state
+struct WALLPAPERCACHE {
+	BOOL isEnabled;		///< Cache is enabled
+	int animatedPeriod;	///< Number of frames the animated wallpaper cache is used for
+	DWORD handle;		///< Render target handle (0 if not created)
+	int requestWidth;	///< Screen width the target is created for (pixels)
+	int requestHeight;	///< Screen height the target is created for (pixels)
+	int targetWidth;	///< Render target width (pixels)
+	int targetHeight;	///< Render target height (pixels)
+	DWORD failedGeneration;	///< Cache generation the render target has failed at (0 if it has not failed)
+	BOOL isValid;		///< Target contains the wallpaper of the key below
+	DWORD generation;	///< Cache generation the target is rendered at
+	int type;			///< Cached wallpaper type
+	int detail;			///< Cached wallpaper detail level
+	TEXTURE txr;		///< Cached wallpaper texture
+	int screenWidth;	///< Screen width the target is rendered for (pixels)
+	int screenHeight;	///< Screen height the target is rendered for (pixels)
+	int width;			///< Rendered area width (pixels)
+	int height;			///< Rendered area height (pixels)
+	TEXTURE targetTxr;	///< Rendered area of the target
+	int frameCount;		///< Number of frames since the target is rendered
+};
+
+/// Cache generation. All pages rendered at the older generations are invalid. It is changed under the shared lock
+static DWORD cacheGeneration = 1;
+
+// checks if the page contains the wallpaper for the current frame
+static BOOL isCacheValid(WALLPAPERCACHE *cache, DRAWCONTEXT *dc, TEXTURE *txr, int type, int detail, BOOL isAnimated) {
+	const DRAWCONSTANTS *constants = getDrawConstants(dc);
+
+	return cache->isValid
+		&& cache->generation == cacheGeneration
+		&& cache->type == type
+		&& cache->detail == detail
+		&& cache->screenWidth == constants->screenWidth
+		&& cache->screenHeight == constants->screenHeight
+		&& cache->txr.handle == txr->handle
+		&& cache->txr.x == txr->x
+		&& cache->txr.y == txr->y
+		&& cache->txr.width == txr->width
+		&& cache->txr.height == txr->height
+		&& (!isAnimated || cache->frameCount < cache->animatedPeriod);
+}
+
+// gets the rendered area size along the axis, so its edge is the whole texture coordinate unit (1/TEXPAGE_SIZE of the target)
+static int getCacheAreaSize(int size, int targetSize, int *units) {
+	*units = (size * TEXPAGE_SIZE + targetSize/2) / targetSize;
+	if( *units < 1 )
+		*units = 1;
+	if( *units > TEXPAGE_SIZE )
+		*units = TEXPAGE_SIZE;
+	return *units * targetSize / TEXPAGE_SIZE;
+}
+
+// sets the rendered area of the target. It keeps the screen aspect ratio, so the pattern layout is the same
+static void setCacheArea(WALLPAPERCACHE *cache, int screenWidth, int screenHeight) {
+	int width = screenWidth;
+	int height = screenHeight;
+
+	if( width > cache->targetWidth ) {
+		height = height * cache->targetWidth / width;
+		width = cache->targetWidth;
+	}
+	if( height > cache->targetHeight ) {
+		width = width * cache->targetHeight / height;
+		height = cache->targetHeight;
+	}
+	cache->width = getCacheAreaSize(width, cache->targetWidth, &cache->targetTxr.width);
+	cache->height = getCacheAreaSize(height, cache->targetHeight, &cache->targetTxr.height);
+	cache->targetTxr.handle = cache->handle;
+	cache->targetTxr.x = 0;
+	cache->targetTxr.y = 0;
+}
+
+// creates the render target for the screen size, returns FALSE if it cannot be created
+static BOOL createCacheTarget(WALLPAPERCACHE *cache, int screenWidth, int screenHeight) {
+	int width = screenWidth;
+	int height = screenHeight;
+
+	if( cache->handle != 0 && cache->requestWidth == screenWidth && cache->requestHeight == screenHeight )
+		return TRUE;
+
+	releaseTexturePage(cache->handle);
+	cache->handle = createTargetTexture(&width, &height);
+	if( cache->handle != 0 && (width <= 0 || height <= 0) ) {
+		releaseTexturePage(cache->handle);
+		cache->handle = 0;
+	}
+	if( cache->handle == 0 )
+		return FALSE;
+
+	cache->requestWidth = screenWidth;
+	cache->requestHeight = screenHeight;
+	cache->targetWidth = width;
+	cache->targetHeight = height;
+	return TRUE;
+}
+
+// renders the wallpaper to the target, returns FALSE if the target cannot be created or set
+static BOOL renderCache(WALLPAPERCACHE *cache, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int type, int detail,
+						WALLPAPERFUNC func, void *param)
+{
+	const DRAWCONSTANTS *constants = getDrawConstants(dc);
+	int screenWidth = constants->screenWidth;
+	int screenHeight = constants->screenHeight;
+
+	if( screenWidth <= 0 || screenHeight <= 0 )
+		return FALSE;
+
+	// the failure is not retried every frame, only after the invalidation
+	if( !createCacheTarget(cache, screenWidth, screenHeight) ) {
+		cache->failedGeneration = cacheGeneration;
+		return FALSE;
+	}
+	setCacheArea(cache, screenWidth, screenHeight);
+
+	flushDrawBatch(dc, ctx);
+	if( !setTexturePageTarget(cache->handle) ) {
+		cache->failedGeneration = cacheGeneration;
+		return FALSE;
+	}
+
+	TR2CONTEXT pageCtx = *ctx;
+	pageCtx.pScreenWidth = &cache->width;
+	pageCtx.pScreenHeight = &cache->height;
+	updateDrawConstants(dc, &pageCtx);
+	func(param, dc, &pageCtx, txr);
+	flushDrawBatch(dc, &pageCtx);
+
+	setTexturePageTarget(0);
+	updateDrawConstants(dc, ctx);
+
+	cache->isValid = TRUE;
+	cache->generation = cacheGeneration;
+	cache->type = type;
+	cache->detail = detail;
+	cache->txr = *txr;
+	cache->screenWidth = screenWidth;
+	cache->screenHeight = screenHeight;
+	cache->frameCount = 0;
+	return TRUE;
+}
+
+WALLPAPERCACHE *createWallpaperCache(void) {
+	WALLPAPERCACHE *cache = calloc(1, sizeof(WALLPAPERCACHE));
+
+	if( cache == NULL )
+		return NULL;
+	countAllocation(sizeof(WALLPAPERCACHE));
+
+	cache->animatedPeriod = CACHE_ANIMATED_PERIOD;
+	return cache;
+}
+
+void freeWallpaperCache(WALLPAPERCACHE *cache, BOOL releasePage) {
+	if( cache == NULL )
+		return;
+
+	if( releasePage )
+		releaseTexturePage(cache->handle);
+	free(cache);
+}
+
+void setWallpaperCache(WALLPAPERCACHE *cache, BOOL enable, int animatedPeriod) {
+	if( !enable && cache->handle != 0 ) {
+		releaseTexturePage(cache->handle);
+		cache->handle = 0;
+	}
+	cache->isEnabled = enable;
+	cache->animatedPeriod = ( animatedPeriod > 0 ) ? animatedPeriod : CACHE_ANIMATED_PERIOD;
+	cache->isValid = FALSE;
+	cache->failedGeneration = 0;
+}
+
+void invalidateWallpaperCache(WALLPAPERCACHE *cache) {
+	cache->isValid = FALSE;
+}
+
+void invalidateWallpaperCaches(void) {
+	lockSharedState();
+	++cacheGeneration;
+	unlockSharedState();
+}
+
+BOOL drawCachedWallpaper(WALLPAPERCACHE *cache, DRAWCONTEXT *dc, TR2CONTEXT *ctx, TEXTURE *txr, int type, int detail,
+						 BOOL isAnimated, WALLPAPERFUNC func, void *param)
+{
+	if( !cache->isEnabled )
+		return FALSE;
+
+	// the render target of the game is switched, so no other thread may draw meanwhile
+	lockSharedState();
+	if( cache->failedGeneration == cacheGeneration ) {
+		unlockSharedState();
+		return FALSE;
+	}
+	if( !isCacheValid(cache, dc, txr, type, detail, isAnimated) && !renderCache(cache, dc, ctx, txr, type, detail, func, param) ) {
+		unlockSharedState();
+		cache->isValid = FALSE;
+		return FALSE;
+	}
+	++cache->frameCount;
+
+	const DRAWCONSTANTS *constants = getDrawConstants(dc);
+	D3DCOLOR color = grayToRGBA(255, FALSE);
+	VERTEX2D vtx[4] = {
+		{0.0,							0.0,							color},
+		{(float)constants->screenWidth,	0.0,							color},
+		{0.0,							(float)constants->screenHeight,	color},
+		{(float)constants->screenWidth,	(float)constants->screenHeight,	color},
+	};
+	renderTexturedFarQuad(dc, ctx, &vtx[0], &vtx[1], &vtx[2], &vtx[3], &cache->targetTxr);
+	unlockSharedState();
+	return TRUE;
+}
+
+/** @} */
@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2017 Michael Chaban. All rights reserved.
+ *
+ * This file is part of TR2Draw.
+ *
+ * TR2Draw is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * TR2Draw is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with TR2Draw.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * @brief Worker pool
+ *
+ * This file implements persistent worker thread pool for the grid generation
+ */
+
+/**
+ * @defgroup WORKER_POOL Worker pool
+ * @brief Worker thread pool
+ *
+ * This module contains the pool of worker threads the grid columns are
+ * generated by. The items are split into bands, and each participating
+ * thread gets its own contiguous range of bands. A band is taken by the
+ * atomic increment of the range counter, so when a thread runs out of
+ * its own bands it steals the bands from the ranges of the other threads
+ * the same way. Only one work is run on the pool at a time: if the
+ * wallpaper instances are drawn by several threads, the work of a thread
+ * finding the pool busy is executed inline.
+ *
+ * On Windows each worker thread holds a reference to the library and
+ * exits by FreeLibraryAndExitThread() after WORKER_IDLE_TIMEOUT without
+ * work, so the library is never unmapped under a running worker, and it
+ * is unloaded after FreeLibrary() as soon as the workers become idle.
+ * The exited workers are started again by the next work
+ *
+ * @{
+ */
+
+#include "workerPool.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif // _WIN32
+
+/// Counter changed by the interlocked operations
+typedef volatile LONG ATOMICLONG;
+
+/// Band range of one participating thread. It takes the whole cache line, so the counters do not share one
+typedef struct {
+	ATOMICLONG next;	///< Next band to take
+	LONG end;			///< Band after the last one of the range
+	BYTE padding[64 - sizeof(LONG)*2];	///< Cache line padding
+} BANDRANGE;
+
+/// Work currently run by the pool
+typedef struct {
+	WORKFUNC func;	///< Work function
+	void *param;	///< Work parameter
+	int count;		///< Number of items
+	int bandSize;	///< Number of items per band
+	int threadCount;	///< Number of participating threads (workers plus the calling thread)
+	BANDRANGE ranges[WORKER_MAX+1];	///< Band ranges of the participating threads
+} POOLWORK;
+
+/// Current work
+static POOLWORK work;
+/// Number of worker threads requested (negative means default)
+static int requestedWorkerCount = -1;
+/// Number of worker threads used by the work
+static int workerCount = 0;
+/// Pool start indicator
+static BOOL isPoolStarted = FALSE;
+/// Pool stop request
+static volatile BOOL isStopRequested = FALSE;
+/// Number of workers that have not finished the current work yet
+static ATOMICLONG pendingCount = 0;
+/// Pool use indicator. The thread that sets it owns the pool and the current work
+static ATOMICLONG isPoolBusy = 0;
+
+#ifdef _WIN32
+/// Worker thread states
+enum {
+	WORKER_EXITED,	///< Thread is not running (or it is exiting)
+	WORKER_IDLE,	///< Thread waits for the work
+	WORKER_BUSY,	///< Thread is given the work
+};
+
+/// Worker thread states. The idle state is changed only by the interlocked compare-exchange
+static ATOMICLONG workerStates[WORKER_MAX];
+/// Worker threads (NULL if the thread has never been started)
+static HANDLE workerThreads[WORKER_MAX];
+/// Work start events (auto-reset, one per worker). The event is set only for the worker in the busy state
+static HANDLE startEvents[WORKER_MAX];
+/// Work done event (manual-reset)
+static HANDLE doneEvent = NULL;
+/// Library module. Each worker thread holds a reference to it
+static HMODULE workerModule = NULL;
+#else // _WIN32
+/// Worker threads
+static pthread_t workerThreads[WORKER_MAX];
+/// Pool mutex
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+/// Work start condition
+static pthread_cond_t startCondition = PTHREAD_COND_INITIALIZER;
+/// Work done condition
+static pthread_cond_t doneCondition = PTHREAD_COND_INITIALIZER;
+/// Work generation. Workers start when it is changed
+static DWORD workGeneration = 0;
+#endif // _WIN32
+
+// takes band from the range, returns -1 if the range has no more bands
+static int takeBand(BANDRANGE *range) {
+	LONG band = InterlockedIncrement(&range->next) - 1;
+	return ( band < range->end ) ? band : -1;
+}
+
+// processes own bands of the thread, then steals the bands of the other threads
+static void runBands(int thread) {
+	for( int k=0; k<work.threadCount; ++k ) {
+		BANDRANGE *range = &work.ranges[(thread + k) % work.threadCount];
+		int band;
+
+		while( (band = takeBand(range)) >= 0 ) {
+			int begin = band * work.bandSize;
+			int end = begin + work.bandSize;
+			work.func(work.param, begin, ( end < work.count ) ? end : work.count);
+		}
+	}
+}
+
+static int getDefaultWorkerCount(void) {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int processorCount = info.dwNumberOfProcessors;
+#else // _WIN32
+	int processorCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif // _WIN32
+	return processorCount - 1;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI workerProc(LPVOID param) {
+	int thread = (int)(size_t)param;
+	ATOMICLONG *state = &workerStates[thread-1];
+
+	for(;;) {
+		if( WaitForSingleObject(startEvents[thread-1], WORKER_IDLE_TIMEOUT) == WAIT_TIMEOUT ) {
+			// the idle worker exits, unless the work has just been given to it
+			if( InterlockedCompareExchange(state, WORKER_EXITED, WORKER_IDLE) == WORKER_IDLE )
+				break;
+			continue;
+		}
+		if( isStopRequested ) {
+			InterlockedExchange(state, WORKER_EXITED);
+			break;
+		}
+		runBands(thread);
+		InterlockedExchange(state, WORKER_IDLE);
+		if( InterlockedDecrement(&pendingCount) == 0 )
+			SetEvent(doneEvent);
+	}
+	// the thread holds its own module reference, so the library stays mapped until it exits
+	FreeLibraryAndExitThread(workerModule, 0);
+	return 0;
+}
+
+// starts worker thread in the busy state
+static BOOL startWorker(int i) {
+	HMODULE module;
+
+	// the handle of the exited thread is not needed anymore
+	if( workerThreads[i] != NULL ) {
+		CloseHandle(workerThreads[i]);
+		workerThreads[i] = NULL;
+	}
+	if( startEvents[i] == NULL ) {
+		startEvents[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+		if( startEvents[i] == NULL )
+			return FALSE;
+	}
+	// the reference is released by the worker thread on exit
+	if( !GetModuleHandleEx(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, (LPCTSTR)workerProc, &module) )
+		return FALSE;
+	workerModule = module;
+	workerStates[i] = WORKER_BUSY;
+	workerThreads[i] = CreateThread(NULL, 0, workerProc, (LPVOID)(size_t)(i+1), 0, NULL);
+	if( workerThreads[i] == NULL ) {
+		workerStates[i] = WORKER_EXITED;
+		FreeLibrary(module);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// gives the current work to the worker, starting its thread if it has exited
+static BOOL wakeWorker(int i) {
+	if( InterlockedCompareExchange(&workerStates[i], WORKER_BUSY, WORKER_IDLE) != WORKER_IDLE && !startWorker(i) )
+		return FALSE;
+	SetEvent(startEvents[i]);
+	return TRUE;
+}
+#else // _WIN32
+static void *workerProc(void *param) {
+	int thread = (int)(size_t)param;
+	DWORD generation = 0;
+
+	for(;;) {
+		pthread_mutex_lock(&poolMutex);
+		while( workGeneration == generation && !isStopRequested )
+			pthread_cond_wait(&startCondition, &poolMutex);
+		generation = workGeneration;
+		pthread_mutex_unlock(&poolMutex);
+
+		if( isStopRequested )
+			return NULL;
+		runBands(thread);
+
+		pthread_mutex_lock(&poolMutex);
+		if( --pendingCount == 0 )
+			pthread_cond_signal(&doneCondition);
+		pthread_mutex_unlock(&poolMutex);
+	}
+}
+#endif // _WIN32
+
+// starts the pool. On Windows the worker threads are started by the work
+static void startWorkerPool(void) {
+	int count = ( requestedWorkerCount >= 0 ) ? requestedWorkerCount : getDefaultWorkerCount();
+
+	if( count > WORKER_MAX ) count = WORKER_MAX;
+	isPoolStarted = TRUE;
+	isStopRequested = FALSE;
+	workerCount = 0;
+
+#ifdef _WIN32
+	if( count > 0 && doneEvent == NULL ) {
+		doneEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		if( doneEvent == NULL )
+			return;
+	}
+	workerCount = count;
+#else // _WIN32
+	// if a thread cannot be started, the pool works with fewer threads
+	workGeneration = 0;
+	for( int i=0; i<count; ++i ) {
+		if( pthread_create(&workerThreads[i], NULL, workerProc, (void *)(size_t)(i+1)) )
+			break;
+		++workerCount;
+	}
+#endif // _WIN32
+}
+
+// runs work on the pool owned by the calling thread
+static void runPoolWork(WORKFUNC func, void *param, int count, int minBandSize) {
+	if( !isPoolStarted )
+		startWorkerPool();
+
+	if( workerCount == 0 ) {
+		func(param, 0, count);
+		return;
+	}
+
+	int threadCount = workerCount + 1;
+	int bandSize = (count + threadCount*WORK_BANDS_PER_THREAD - 1) / (threadCount*WORK_BANDS_PER_THREAD);
+	if( bandSize < minBandSize ) bandSize = minBandSize;
+	int bandCount = (count + bandSize - 1) / bandSize;
+	if( threadCount > bandCount ) threadCount = bandCount;
+
+	work.func = func;
+	work.param = param;
+	work.count = count;
+	work.bandSize = bandSize;
+	work.threadCount = threadCount;
+	for( int i=0; i<threadCount; ++i ) {
+		work.ranges[i].next = bandCount * i / threadCount;
+		work.ranges[i].end = bandCount * (i+1) / threadCount;
+	}
+
+#ifdef _WIN32
+	// only the workers having own bands are woken up. The calling thread holds one count,
+	// so the done event is not set before all workers are woken up. The bands of the worker
+	// that cannot be started are stolen by the other threads
+	pendingCount = 1;
+	ResetEvent(doneEvent);
+	for( int i=0; i<threadCount-1; ++i ) {
+		InterlockedIncrement(&pendingCount);
+		if( !wakeWorker(i) )
+			InterlockedDecrement(&pendingCount);
+	}
+	runBands(0);
+	if( InterlockedDecrement(&pendingCount) != 0 )
+		WaitForSingleObject(doneEvent, INFINITE);
+#else // _WIN32
+	pthread_mutex_lock(&poolMutex);
+	pendingCount = workerCount;
+	++workGeneration;
+	pthread_cond_broadcast(&startCondition);
+	pthread_mutex_unlock(&poolMutex);
+
+	runBands(0);
+
+	pthread_mutex_lock(&poolMutex);
+	while( pendingCount > 0 )
+		pthread_cond_wait(&doneCondition, &poolMutex);
+	pthread_mutex_unlock(&poolMutex);
+#endif // _WIN32
+}
+
+void runParallel(WORKFUNC func, void *param, int count, int minBandSize) {
+	if( minBandSize < 1 ) minBandSize = 1;
+
+	// small work, or the pool is used by another thread
+	if( count < minBandSize*2 || InterlockedCompareExchange(&isPoolBusy, 1, 0) != 0 ) {
+		func(param, 0, count);
+		return;
+	}
+	runPoolWork(func, param, count, minBandSize);
+	InterlockedExchange(&isPoolBusy, 0);
+}
+
+// waits until the work of another thread is done, and takes the pool
+static void acquirePool(void) {
+	while( InterlockedCompareExchange(&isPoolBusy, 1, 0) != 0 ) {
+#ifdef _WIN32
+		Sleep(1);
+#else // _WIN32
+		usleep(1000);
+#endif // _WIN32
+	}
+}
+
+// stops the worker threads of the pool owned by the calling thread
+static void stopPoolThreads(void) {
+	if( !isPoolStarted )
+		return;
+
+#ifdef _WIN32
+	// only the idle workers are woken up: the exited ones must not get the stale start event
+	isStopRequested = TRUE;
+	for( int i=0; i<WORKER_MAX; ++i ) {
+		if( InterlockedCompareExchange(&workerStates[i], WORKER_BUSY, WORKER_IDLE) == WORKER_IDLE )
+			SetEvent(startEvents[i]);
+	}
+	for( int i=0; i<WORKER_MAX; ++i ) {
+		if( workerThreads[i] != NULL ) {
+			WaitForSingleObject(workerThreads[i], INFINITE);
+			CloseHandle(workerThreads[i]);
+			workerThreads[i] = NULL;
+		}
+	}
+#else // _WIN32
+	pthread_mutex_lock(&poolMutex);
+	isStopRequested = TRUE;
+	pthread_cond_broadcast(&startCondition);
+	pthread_mutex_unlock(&poolMutex);
+	for( int i=0; i<workerCount; ++i )
+		pthread_join(workerThreads[i], NULL);
+#endif // _WIN32
+
+	workerCount = 0;
+	isPoolStarted = FALSE;
+}
+
+void setWorkerCount(int count) {
+	acquirePool();
+	stopPoolThreads();
+	requestedWorkerCount = count;
+	InterlockedExchange(&isPoolBusy, 0);
+}
+
+void stopWorkerPool(void) {
+	acquirePool();
+	stopPoolThreads();
+	InterlockedExchange(&isPoolBusy, 0);
+}
+
+void releaseWorkerPool(void) {
+#ifdef _WIN32
+	for( int i=0; i<WORKER_MAX; ++i ) {
+		if( workerThreads[i] != NULL ) {
+			CloseHandle(workerThreads[i]);
+			workerThreads[i] = NULL;
+		}
+		if( startEvents[i] != NULL ) {
+			CloseHandle(startEvents[i]);
+			startEvents[i] = NULL;
+		}
+	}
+	if( doneEvent != NULL ) {
+		CloseHandle(doneEvent);
+		doneEvent = NULL;
+	}
+#endif // _WIN32
+	workerCount = 0;
+	isPoolStarted = FALSE;
+}
+
+/** @} */